@@ -0,0 +1,154 @@
+// See LICENSE.SiFive for license details.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "SimCommitLog.h"
+#include "commit_log.h"
+#ifdef COSIM
+#include "cosim.h"
+#endif
+
+static int log_fd = -1;
+static bool header_written = false;
+static std::vector<char> log_buf;
+static commit_log_encoder_t encoder;
+
+static const size_t flush_size = 1 << 20;
+
+static void flush_log()
+{
+  const char* p = log_buf.data();
+  size_t len = log_buf.size();
+  while (len) {
+    ssize_t n = write(log_fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      fprintf(stderr, "commit log: %s\n", strerror(errno));
+      abort();
+    }
+    p += n;
+    len -= n;
+  }
+  log_buf.clear();
+}
+
+bool commit_log_open(const char* path)
+{
+  log_fd = strcmp(path, "-") == 0 ? STDOUT_FILENO :
+           open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  log_buf.reserve(flush_size + commit_log_encoder_t::max_record_size);
+  return log_fd >= 0;
+}
+
+void commit_log_close()
+{
+  if (log_fd < 0)
+    return;
+  flush_log();
+  if (log_fd != STDOUT_FILENO)
+    close(log_fd);
+  log_fd = -1;
+}
+
+// The widths of the model's signals come with every record, packed as
+// hartid bits | PC bits << 8 | XLEN << 16 | FLEN << 24, so that a model
+// restored from a checkpoint has them too; the first record sets the
+// header.
+static void log_record(int widths, const commit_log_record_t& r)
+{
+  if (!header_written) {
+    commit_log_header_t h;
+    commit_log_header_init(&h, widths & 0xff, (widths >> 8) & 0xff,
+                           (widths >> 16) & 0xff, (widths >> 24) & 0xff);
+    const char* p = reinterpret_cast<const char*>(&h);
+    log_buf.insert(log_buf.end(), p, p + sizeof(h));
+    header_written = true;
+  }
+  encoder.encode(r, log_buf);
+  if (log_buf.size() >= flush_size)
+    flush_log();
+}
+
+// Whether anything wants the records: the log, or spike (--cosim).
+static bool wanted()
+{
+#ifdef COSIM
+  if (cosim_enabled())
+    return true;
+#endif
+  return log_fd >= 0;
+}
+
+extern "C" void commit_log_commit
+(
+  int       widths,
+  int       hartid,
+  int       priv,
+  long long pc,
+  int       insn,
+  int       has_rd,
+  int       fp,
+  int       partial,
+  int       rd,
+  int       pdst,
+  long long data
+)
+{
+  if (!wanted())
+    return;
+
+  commit_log_record_t r;
+  r.kind = COMMIT_LOG_COMMIT;
+  r.hart = hartid;
+  r.priv = priv;
+  r.pc = pc;
+  r.insn = insn;
+  r.has_rd = has_rd;
+  r.fp = fp;
+  r.partial = partial;
+  r.rd = rd;
+  r.pdst = pdst;
+  r.data = data;
+  if (log_fd >= 0)
+    log_record(widths, r);
+#ifdef COSIM
+  if (cosim_enabled())
+    cosim_commit(widths, r);
+#endif
+}
+
+extern "C" void commit_log_writeback
+(
+  int       widths,
+  int       hartid,
+  int       fp,
+  int       rd,
+  int       pdst,
+  long long data
+)
+{
+  if (!wanted())
+    return;
+
+  commit_log_record_t r;
+  r.kind = COMMIT_LOG_WRITEBACK;
+  r.hart = hartid;
+  r.fp = fp;
+  r.rd = rd;
+  r.pdst = pdst;
+  r.data = data;
+  if (log_fd >= 0)
+    log_record(widths, r);
+#ifdef COSIM
+  if (cosim_enabled())
+    cosim_writeback(widths, r);
+#endif
+}
@@ -0,0 +1,13 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef SIMCOMMITLOG_H
+#define SIMCOMMITLOG_H
+
+// Write the commit log that SimCommitLog sees to path, in the binary format
+// of commit_log.h, from now until commit_log_close(). Only models built with
+// enableCommitLog have a commit log to write. Returns false if path cannot
+// be created.
+bool commit_log_open(const char* path);
+void commit_log_close();
+
+#endif
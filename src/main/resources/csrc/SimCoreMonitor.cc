@@ -0,0 +1,29 @@
+// See LICENSE.SiFive for license details.
+
+#include <svdpi.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "SimCoreMonitor.h"
+
+// The scope of each SimCoreMonitor, in which its exported
+// core_monitor_count reads its own count.
+static std::vector<svScope> monitors;
+
+extern "C" long long core_monitor_count();
+
+extern "C" void core_monitor_attach()
+{
+  monitors.push_back(svGetScope());
+}
+
+uint64_t core_monitor_instret()
+{
+  uint64_t total = 0;
+  for (auto scope : monitors) {
+    svSetScope(scope);
+    total += core_monitor_count();
+  }
+  return total;
+}
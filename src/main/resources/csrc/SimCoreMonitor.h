@@ -0,0 +1,12 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef SIMCOREMONITOR_H
+#define SIMCOREMONITOR_H
+
+#include <stdint.h>
+
+// Instructions retired so far by all harts, as counted by SimCoreMonitor;
+// one DPI call into each of them, so meant for intervals, not every cycle.
+uint64_t core_monitor_instret();
+
+#endif
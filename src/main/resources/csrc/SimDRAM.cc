@@ -0,0 +1,469 @@
+// See LICENSE.SiFive for license details.
+
+#include <svdpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SimDRAM.h"
+#include "dram_timing.h"
+#include "mem_backdoor.h"
+#include "sim_stats.h"
+
+static const uint64_t page_size = 4096;
+static const unsigned max_data_bytes = 64;      // the width of the DPI data
+
+enum {
+  AXI_BURST_FIXED = 0,
+  AXI_BURST_INCR = 1,
+  AXI_BURST_WRAP = 2,
+};
+
+enum {
+  AXI_RESP_OKAY = 0,
+  AXI_RESP_DECERR = 3,
+};
+
+static std::unordered_map<uint64_t, uint8_t*> pages;
+// The page last looked up, which is nearly always the next one wanted.
+static uint64_t last_page = 1;
+static uint8_t* last_data = NULL;
+
+// The page holding addr, allocating it if alloc is set; NULL if it has never
+// been written.
+static uint8_t* find_page(uint64_t addr, bool alloc)
+{
+  uint64_t page = addr & ~(page_size - 1);
+  if (page == last_page && (last_data || !alloc))
+    return last_data;
+
+  auto it = pages.find(page);
+  uint8_t* data = it == pages.end() ? NULL : it->second;
+  if (!data && alloc) {
+    data = static_cast<uint8_t*>(calloc(1, page_size));
+    if (!data) {
+      fprintf(stderr, "SimDRAM: out of memory after %llu pages\n",
+              (unsigned long long)pages.size());
+      abort();
+    }
+    pages[page] = data;
+  }
+  last_page = page;
+  last_data = data;
+  return data;
+}
+
+static void copy_page(uint64_t addr, const uint8_t* data, size_t len)
+{
+  memcpy(find_page(addr, true), data, len);
+}
+
+uint64_t sim_dram_resident()
+{
+  return pages.size() * page_size;
+}
+
+// A read or write burst as AR or AW gave it, and the beat it is at. Its
+// response is due from cycle start on, and, for a read, the rest of its
+// beats spread over the cycles up to end.
+struct sim_dram_burst_t
+{
+  uint64_t addr;
+  uint64_t sent;
+  uint64_t start;
+  uint64_t end;
+  uint32_t id;
+  uint32_t len;
+  uint32_t size;
+  uint32_t burst;
+  uint32_t beat;
+  uint32_t resp;
+};
+
+struct sim_dram_port_t
+{
+  std::string path;
+  uint64_t base;
+  uint64_t size;
+  uint32_t data_bytes;
+  int backdoor;
+  bool started;
+  uint64_t cycle;
+  dram_timing_t* timing;        // NULL for no timing model
+  // What the port drove last cycle, for telling which handshakes happened.
+  bool ar_ready, aw_ready, w_ready, b_valid, r_valid;
+  std::deque<sim_dram_burst_t> reads;
+  std::deque<sim_dram_burst_t> writes;  // waiting for W beats
+  std::deque<sim_dram_burst_t> bresps;
+};
+
+static std::vector<sim_dram_port_t*> ports;
+static bool timing_enabled = false;
+static dram_timing_params_t timing_params;
+
+bool sim_dram_configure(const char* filename)
+{
+  timing_enabled = dram_timing_load(filename, &timing_params);
+  return timing_enabled;
+}
+
+unsigned sim_dram_ports()
+{
+  return ports.size();
+}
+
+static uint64_t parse_param(const char* path, const char* name, const char* value)
+{
+  char* end;
+  uint64_t x = strtoull(value, &end, 0);
+  if (!*value || *end) {
+    fprintf(stderr, "SimDRAM %s: bad %s \"%s\"\n", path, name, value);
+    abort();
+  }
+  return x;
+}
+
+extern "C" int sim_dram_attach(const char* path, const char* base, const char* size, int data_bits)
+{
+  // A restored checkpoint brings its ports with it.
+  for (size_t i = 0; i < ports.size(); i++) {
+    if (ports[i]->path == path)
+      return i;
+  }
+
+  if (data_bits % 8 != 0 || data_bits / 8 > (int)max_data_bytes) {
+    fprintf(stderr, "SimDRAM %s: cannot serve %d-bit data\n", path, data_bits);
+    abort();
+  }
+
+  sim_dram_port_t* port = new sim_dram_port_t();
+  port->path = path;
+  port->base = parse_param(path, "MEM_BASE", base);
+  port->size = parse_param(path, "MEM_SIZE", size);
+  port->data_bytes = data_bits / 8;
+  port->backdoor = mem_backdoor_attach_host(path, port->base, port->size);
+  if (timing_enabled)
+    port->timing = new dram_timing_t(timing_params);
+  ports.push_back(port);
+  return ports.size() - 1;
+}
+
+// The address of the current beat of b.
+static uint64_t beat_addr(const sim_dram_burst_t& b)
+{
+  uint64_t bytes = uint64_t(1) << b.size;
+  switch (b.burst) {
+    case AXI_BURST_FIXED:
+      return b.addr;
+    case AXI_BURST_WRAP: {
+      uint64_t span = bytes * (b.len + 1);
+      uint64_t lo = b.addr & ~(span - 1);
+      return lo + ((b.addr + b.beat * bytes) & (span - 1));
+    }
+    default:
+      return b.beat ? (b.addr & ~(bytes - 1)) + b.beat * bytes : b.addr;
+  }
+}
+
+static uint32_t check_range(const sim_dram_port_t* port, const sim_dram_burst_t& b)
+{
+  uint64_t last = b.addr + ((uint64_t(b.len) + 1) << b.size) - 1;
+  if (b.addr < port->base || last - port->base >= port->size)
+    return AXI_RESP_DECERR;
+  return AXI_RESP_OKAY;
+}
+
+// Each beat carries the data_bytes-aligned bytes around its address; the
+// master picks out the lanes it wants.
+static void read_beat(const sim_dram_port_t* port, const sim_dram_burst_t& b, svBitVecVal* data)
+{
+  memset(data, 0, max_data_bytes);
+  if (b.resp != AXI_RESP_OKAY)
+    return;
+  uint64_t addr = beat_addr(b) & ~uint64_t(port->data_bytes - 1);
+  const uint8_t* page = find_page(addr, false);
+  if (page)
+    memcpy(data, page + (addr & (page_size - 1)), port->data_bytes);
+}
+
+static void write_beat(const sim_dram_port_t* port, const sim_dram_burst_t& b,
+                       const svBitVecVal* data, uint64_t strb)
+{
+  if (b.resp != AXI_RESP_OKAY || !strb)
+    return;
+  uint64_t addr = beat_addr(b) & ~uint64_t(port->data_bytes - 1);
+  uint8_t* page = find_page(addr, true) + (addr & (page_size - 1));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  for (unsigned i = 0; i < port->data_bytes; i++) {
+    if (strb >> i & 1)
+      page[i] = bytes[i];
+  }
+}
+
+static sim_dram_burst_t make_burst(const sim_dram_port_t* port, int id, long long addr,
+                                   int len, int size, int burst)
+{
+  sim_dram_burst_t b;
+  b.addr = addr;
+  b.sent = b.start = b.end = port->cycle;
+  b.id = id;
+  b.len = len;
+  b.size = size;
+  b.burst = burst;
+  b.beat = 0;
+  b.resp = check_range(port, b);
+  return b;
+}
+
+// Have the timing model, if any, say when b's data is on the bus.
+static void schedule(sim_dram_port_t* port, sim_dram_burst_t& b, bool write)
+{
+  if (port->timing && b.resp == AXI_RESP_OKAY)
+    port->timing->access(port->cycle, b.addr, (uint64_t(b.len) + 1) << b.size, write,
+                         &b.start, &b.end);
+}
+
+// The cycle the current beat of read b is due.
+static uint64_t beat_due(const sim_dram_burst_t& b)
+{
+  return b.start + (b.end - b.start) * b.beat / (b.len + 1);
+}
+
+extern "C" void sim_dram_tick
+(
+  int            handle,
+
+  unsigned char  ar_valid,
+  unsigned char* ar_ready,
+  int            ar_id,
+  long long      ar_addr,
+  int            ar_len,
+  int            ar_size,
+  int            ar_burst,
+
+  unsigned char  aw_valid,
+  unsigned char* aw_ready,
+  int            aw_id,
+  long long      aw_addr,
+  int            aw_len,
+  int            aw_size,
+  int            aw_burst,
+
+  unsigned char  w_valid,
+  unsigned char* w_ready,
+  const svBitVecVal* w_data,
+  long long      w_strb,
+  unsigned char  w_last,
+
+  unsigned char* b_valid,
+  unsigned char  b_ready,
+  int*           b_id,
+  int*           b_resp,
+
+  unsigned char* r_valid,
+  unsigned char  r_ready,
+  int*           r_id,
+  svBitVecVal*   r_data,
+  int*           r_resp,
+  unsigned char* r_last
+)
+{
+  sim_stats_timer_t timer(sim_stats_dpi_ns);
+  sim_dram_port_t* port = ports[handle];
+
+  if (!port->started) {
+    port->started = true;
+    mem_backdoor_claim_host(port->backdoor, copy_page);
+  }
+
+  port->cycle++;
+  if (port->r_valid && r_ready) {
+    sim_dram_burst_t& b = port->reads.front();
+    if (port->timing && b.beat == 0)
+      port->timing->record_latency(false, port->cycle - b.sent);
+    if (b.beat++ == b.len)
+      port->reads.pop_front();
+  }
+  if (port->b_valid && b_ready) {
+    if (port->timing)
+      port->timing->record_latency(true, port->cycle - port->bresps.front().sent);
+    port->bresps.pop_front();
+  }
+  if (port->ar_ready && ar_valid) {
+    port->reads.push_back(make_burst(port, ar_id, ar_addr, ar_len, ar_size, ar_burst));
+    schedule(port, port->reads.back(), false);
+  }
+  if (port->aw_ready && aw_valid)
+    port->writes.push_back(make_burst(port, aw_id, aw_addr, aw_len, aw_size, aw_burst));
+  if (port->w_ready && w_valid) {
+    sim_dram_burst_t& b = port->writes.front();
+    write_beat(port, b, w_data, w_strb);
+    if (w_last || b.beat++ == b.len) {
+      // The write goes to DRAM once all its data is in, and is answered
+      // once it is done.
+      b.start = b.end = port->cycle;
+      schedule(port, b, true);
+      b.start = b.end;
+      port->bresps.push_back(b);
+      port->writes.pop_front();
+    }
+  }
+
+  // W beats are only taken for a burst whose AW has been.
+  port->ar_ready = port->reads.size() < sim_dram_queue_depth;
+  port->aw_ready = port->writes.size() < sim_dram_queue_depth &&
+                   port->bresps.size() < sim_dram_queue_depth;
+  port->w_ready = !port->writes.empty();
+  port->b_valid = !port->bresps.empty() && port->bresps.front().start <= port->cycle;
+  port->r_valid = !port->reads.empty() && beat_due(port->reads.front()) <= port->cycle;
+
+  *ar_ready = port->ar_ready;
+  *aw_ready = port->aw_ready;
+  *w_ready = port->w_ready;
+  *b_valid = port->b_valid;
+  if (port->b_valid) {
+    *b_id = port->bresps.front().id;
+    *b_resp = port->bresps.front().resp;
+  }
+  *r_valid = port->r_valid;
+  if (port->r_valid) {
+    const sim_dram_burst_t& b = port->reads.front();
+    *r_id = b.id;
+    *r_resp = b.resp;
+    *r_last = b.beat == b.len;
+    read_beat(port, b, r_data);
+  }
+}
+
+void sim_dram_print_stats()
+{
+  if (ports.empty())
+    return;
+  fprintf(stderr, "SimDRAM: %.1f MiB of the store in use\n", sim_dram_resident() / 1048576.0);
+  for (sim_dram_port_t* port : ports) {
+    if (port->timing)
+      port->timing->print_stats(stderr, port->path.c_str(), port->cycle);
+  }
+}
+
+bool sim_dram_write_stats(const char* filename)
+{
+  FILE* f = fopen(filename, "w");
+  if (!f) {
+    fprintf(stderr, "Unable to open %s for DRAM statistics\n", filename);
+    return false;
+  }
+  fprintf(f, "{\n");
+  fprintf(f, "  \"resident_bytes\": %llu,\n", (unsigned long long)sim_dram_resident());
+  fprintf(f, "  \"channels\": [");
+  bool first = true;
+  for (sim_dram_port_t* port : ports) {
+    if (!port->timing)
+      continue;
+    fprintf(f, first ? "\n" : ",\n");
+    port->timing->write_json(f, port->path.c_str(), port->cycle);
+    first = false;
+  }
+  fprintf(f, first ? "]\n" : "\n  ]\n");
+  fprintf(f, "}\n");
+  return fclose(f) == 0;
+}
+
+static void save_queue(sim_dram_io_t write, void* ctx, std::deque<sim_dram_burst_t>& q)
+{
+  uint32_t n = q.size();
+  write(ctx, &n, sizeof(n));
+  for (auto& b : q)
+    write(ctx, &b, sizeof(b));
+}
+
+static void restore_queue(sim_dram_io_t read, void* ctx, std::deque<sim_dram_burst_t>& q)
+{
+  uint32_t n;
+  read(ctx, &n, sizeof(n));
+  q.resize(n);
+  for (auto& b : q)
+    read(ctx, &b, sizeof(b));
+}
+
+void sim_dram_save(sim_dram_io_t write, void* ctx)
+{
+  uint32_t nports = ports.size();
+  write(ctx, &nports, sizeof(nports));
+  for (sim_dram_port_t* port : ports) {
+    uint32_t len = port->path.size();
+    write(ctx, &len, sizeof(len));
+    write(ctx, &port->path[0], len);
+    write(ctx, &port->base, sizeof(port->base));
+    write(ctx, &port->size, sizeof(port->size));
+    write(ctx, &port->data_bytes, sizeof(port->data_bytes));
+    bool state[] = {port->started, port->ar_ready, port->aw_ready, port->w_ready,
+                    port->b_valid, port->r_valid, port->timing != NULL};
+    write(ctx, state, sizeof(state));
+    write(ctx, &port->cycle, sizeof(port->cycle));
+    if (port->timing)
+      port->timing->save(write, ctx);
+    save_queue(write, ctx, port->reads);
+    save_queue(write, ctx, port->writes);
+    save_queue(write, ctx, port->bresps);
+  }
+
+  uint64_t npages = pages.size();
+  write(ctx, &npages, sizeof(npages));
+  for (auto& it : pages) {
+    uint64_t addr = it.first;
+    write(ctx, &addr, sizeof(addr));
+    write(ctx, it.second, page_size);
+  }
+}
+
+void sim_dram_restore(sim_dram_io_t read, void* ctx)
+{
+  for (sim_dram_port_t* port : ports) {
+    delete port->timing;
+    delete port;
+  }
+  ports.clear();
+
+  uint32_t nports;
+  read(ctx, &nports, sizeof(nports));
+  for (uint32_t i = 0; i < nports; i++) {
+    sim_dram_port_t* port = new sim_dram_port_t();
+    uint32_t len;
+    read(ctx, &len, sizeof(len));
+    port->path.resize(len);
+    read(ctx, &port->path[0], len);
+    read(ctx, &port->base, sizeof(port->base));
+    read(ctx, &port->size, sizeof(port->size));
+    read(ctx, &port->data_bytes, sizeof(port->data_bytes));
+    bool state[7];
+    read(ctx, state, sizeof(state));
+    port->started = state[0];
+    port->ar_ready = state[1];
+    port->aw_ready = state[2];
+    port->w_ready = state[3];
+    port->b_valid = state[4];
+    port->r_valid = state[5];
+    read(ctx, &port->cycle, sizeof(port->cycle));
+    if (state[6])
+      port->timing = dram_timing_t::restore(read, ctx);
+    port->backdoor = -1;
+    restore_queue(read, ctx, port->reads);
+    restore_queue(read, ctx, port->writes);
+    restore_queue(read, ctx, port->bresps);
+    ports.push_back(port);
+  }
+
+  uint64_t npages;
+  read(ctx, &npages, sizeof(npages));
+  for (uint64_t i = 0; i < npages; i++) {
+    uint64_t addr;
+    read(ctx, &addr, sizeof(addr));
+    read(ctx, find_page(addr, true), page_size);
+  }
+}
@@ -0,0 +1,49 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef SIM_DRAM_H
+#define SIM_DRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The test harness memory of configs built WithSimDRAM, kept on the host
+// instead of in AXI4RAMs.
+//
+// Every SimDRAM in the model serves one AXI4 memory channel of the same
+// address space, so they share one store. The store is sparse: a 4 KiB page
+// is only allocated when it is first written, and reads of any other page
+// return zeros, so a run's RSS follows the pages the program touches however
+// large the memory is. With --fast-load the program goes straight into the
+// store (see mem_backdoor.h).
+//
+// Each SimDRAM takes up to sim_dram_queue_depth bursts of each kind, and
+// answers them in order, a beat a cycle, from the cycle after it has them,
+// or, with a timing model (sim_dram_configure), when the model says their
+// data has come.
+
+static const unsigned sim_dram_queue_depth = 16;
+
+// Give every SimDRAM the DRAM timing model (see dram_timing.h) with the
+// parameters in filename. Returns false, having said why, if the file is
+// wrong.
+bool sim_dram_configure(const char* filename);
+
+// The number of SimDRAMs in the model.
+unsigned sim_dram_ports();
+
+// Bytes of the store allocated so far.
+uint64_t sim_dram_resident();
+
+// What the store holds and, with a timing model, each SimDRAM's latencies,
+// row hits and bus use: lines to stderr, or JSON to filename (false, having
+// said why, if it cannot be written).
+void sim_dram_print_stats();
+bool sim_dram_write_stats(const char* filename);
+
+// The state of the store and of the bursts in flight, for checkpoints; io
+// moves len bytes to or from buf.
+typedef void (*sim_dram_io_t)(void* ctx, void* buf, size_t len);
+void sim_dram_save(sim_dram_io_t write, void* ctx);
+void sim_dram_restore(sim_dram_io_t read, void* ctx);
+
+#endif
@@ -3,9 +3,311 @@
 #include <fesvr/dtm.h>
 #include <vpi_user.h>
 #include <svdpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+
+#include "SimDTM.h"
+#include "sim_stats.h"
 
 dtm_t* dtm;
 
+static bool dtm_recording = false;
+static std::vector<dtm_tick_run_t> dtm_log;
+
+// DMI operations taken from dtm_t, oldest first: those not yet accepted by
+// the debug module, and those accepted but not yet answered. A posted
+// operation is a write dtm_t has already been told succeeded.
+struct dmi_op_t
+{
+  dtm_t::req req;
+  bool posted;
+};
+
+static unsigned dmi_depth = 16;
+static std::deque<dmi_op_t> dmi_unsent;
+static std::deque<bool> dmi_unanswered;
+// Whether dtm_t is waiting on the response to an operation that is not
+// posted.
+static bool dmi_blocked = false;
+// Whether the oldest unsent operation is on the pins. DMIToTL gives every
+// request the same TileLink source, so only one may be between the request
+// and its response at a time; the queue is on this side of the pins.
+static bool dmi_req_on_pins = false;
+// Set by sim_dtm_t::idle() for the NOP it issues, which SimDTM answers
+// itself; dmi_skip is then the number of cycles SimDTM.v waits before the
+// next debug_tick.
+static bool dmi_idle_nop = false;
+static int dmi_skip = 0;
+// Cycles sim_dtm_t::idle() has SimDTM.v sleep for; 0 leaves idling to
+// dtm_t.
+static unsigned dtm_idle_cycles = 0;
+
+enum {
+  DMI_OP_READ = 1,
+  DMI_OP_WRITE = 2,
+};
+
+// What SimDTM may wait for before calling debug_tick again, as a mask.
+// When there is nothing to send or req_ready is low, and nothing to receive
+// or resp_valid is low, a tick changes nothing, so skipping it keeps the
+// run cycle-for-cycle the same.
+enum {
+  DTM_WAIT_NONE = 0,
+  DTM_WAIT_REQ_READY = 1,
+  DTM_WAIT_RESP_VALID = 2,
+};
+
+void dtm_set_idle_skip(unsigned cycles)
+{
+  dtm_idle_cycles = cycles;
+}
+
+unsigned dtm_idle_skip()
+{
+  return dtm_idle_cycles;
+}
+
+void dtm_set_queue_depth(unsigned depth)
+{
+  dmi_depth = depth ? depth : 1;
+}
+
+unsigned dtm_queue_depth()
+{
+  return dmi_depth;
+}
+
+void dtm_set_recording(bool enable)
+{
+  dtm_recording = enable;
+}
+
+const std::vector<dtm_tick_run_t>& dtm_tick_log()
+{
+  return dtm_log;
+}
+
+// Take operations from dtm_t until it has to wait for the debug module.
+static void dmi_fill()
+{
+  dtm_t::resp ok;
+  ok.resp = 0;
+  ok.data = 0;
+
+  while (!dmi_blocked && !dtm->done() &&
+         dmi_unsent.size() + dmi_unanswered.size() < dmi_depth) {
+    if (!dtm->req_valid()) {
+      dtm->tick(false, false, ok);
+      if (!dtm->req_valid())
+        break;
+    }
+
+    if (dmi_idle_nop && dtm->req_bits().op == 0) {
+      // Only once the operations before it are done, so that nothing is
+      // left waiting on the pins while SimDTM.v skips ticks.
+      if (!dmi_unsent.empty() || !dmi_unanswered.empty())
+        break;
+      dmi_idle_nop = false;
+      dtm->tick(true, false, ok);
+      dtm->tick(false, true, ok);
+      dmi_skip = dtm_idle_cycles;
+      break;
+    }
+
+    dmi_op_t op;
+    op.req = dtm->req_bits();
+    op.posted = dmi_depth > 1 && op.req.op == DMI_OP_WRITE;
+    dmi_unsent.push_back(op);
+    dtm->tick(true, false, ok);
+    if (op.posted)
+      dtm->tick(false, true, ok);
+    else
+      dmi_blocked = true;
+  }
+}
+
+static void dtm_tick(bool req_ready, bool resp_valid, dtm_t::resp resp_bits)
+{
+  dmi_skip = 0;
+
+  // SimDTM is always ready for a response.
+  if (resp_valid && !dmi_unanswered.empty()) {
+    bool posted = dmi_unanswered.front();
+    dmi_unanswered.pop_front();
+    if (!posted) {
+      dmi_blocked = false;
+      dtm->tick(false, true, resp_bits);
+    } else if (resp_bits.resp != 0) {
+      fprintf(stderr, "SimDTM: posted DMI write failed (response %u)\n",
+              (unsigned)resp_bits.resp);
+      abort();
+    }
+  }
+  if (req_ready && dmi_req_on_pins) {
+    dmi_unanswered.push_back(dmi_unsent.front().posted);
+    dmi_unsent.pop_front();
+  }
+
+  dmi_fill();
+  dmi_req_on_pins = !dmi_unsent.empty() && dmi_unanswered.empty();
+}
+
+static int dtm_wait()
+{
+  if (!dmi_blocked && !dtm->done() &&
+      dmi_unsent.size() + dmi_unanswered.size() < dmi_depth)
+    return DTM_WAIT_NONE;
+
+  int wait = DTM_WAIT_NONE;
+  if (dmi_req_on_pins)
+    wait |= DTM_WAIT_REQ_READY;
+  if (!dmi_unanswered.empty())
+    wait |= DTM_WAIT_RESP_VALID;
+  return wait;
+}
+
+static void dtm_tick_logged(bool req_ready, bool resp_valid, dtm_t::resp resp_bits)
+{
+  if (dtm_recording) {
+    // The response bits are don't-cares unless resp_valid is set; dropping
+    // them keeps the runs long.
+    if (!resp_valid)
+      resp_bits.resp = resp_bits.data = 0;
+
+    if (!dtm_log.empty() &&
+        dtm_log.back().req_ready == req_ready &&
+        dtm_log.back().resp_valid == resp_valid &&
+        dtm_log.back().resp == resp_bits.resp &&
+        dtm_log.back().data == resp_bits.data) {
+      dtm_log.back().count++;
+    } else {
+      dtm_tick_run_t run;
+      run.count = 1;
+      run.data = resp_bits.data;
+      run.resp = resp_bits.resp;
+      run.req_ready = req_ready;
+      run.resp_valid = resp_valid;
+      dtm_log.push_back(run);
+    }
+  }
+
+  dtm_tick(req_ready, resp_valid, resp_bits);
+}
+
+void dtm_replay(const std::vector<dtm_tick_run_t>& log)
+{
+  for (auto& run : log) {
+    dtm_t::resp resp_bits;
+    resp_bits.resp = run.resp;
+    resp_bits.data = run.data;
+    for (uint64_t i = 0; i < run.count; i++)
+      dtm_tick(run.req_ready, run.resp_valid, resp_bits);
+  }
+  dtm_log = log;
+}
+
+// Debug module registers and sbcs fields used for system bus access.
+enum {
+  DMI_SBCS = 0x38,
+  DMI_SBADDRESS0 = 0x39,
+  DMI_SBADDRESS1 = 0x3a,
+  DMI_SBDATA0 = 0x3c,
+};
+
+static const uint32_t SBCS_SBVERSION_SHIFT = 29;
+static const uint32_t SBCS_SBBUSYERROR = 1u << 22;
+static const uint32_t SBCS_SBBUSY = 1u << 21;
+static const uint32_t SBCS_SBACCESS_32 = 2u << 17;
+static const uint32_t SBCS_SBAUTOINCREMENT = 1u << 16;
+static const uint32_t SBCS_SBERROR = 7u << 12;
+static const uint32_t SBCS_SBASIZE_SHIFT = 5;
+static const uint32_t SBCS_SBASIZE_MASK = 0x7f;
+static const uint32_t SBCS_SBACCESS32 = 1u << 2;
+
+void sim_dtm_t::load_program()
+{
+  sba_loading = dmi_depth > 1;
+  dtm_t::load_program();
+  sba_loading = false;
+}
+
+// dtm_t waits for the target by sending DMI NOPs, each a debug_tick and a
+// switch to fesvr's coroutine. With an idle skip, send one instead, which
+// dmi_fill() answers by having SimDTM.v sleep for dtm_idle_cycles.
+void sim_dtm_t::idle()
+{
+  if (!dtm_idle_cycles) {
+    dtm_t::idle();
+    return;
+  }
+  dmi_idle_nop = true;
+  nop();
+}
+
+void sim_dtm_t::write_chunk(addr_t taddr, size_t len, const void* src)
+{
+  if (!sba_write(taddr, len, src))
+    dtm_t::write_chunk(taddr, len, src);
+}
+
+void sim_dtm_t::clear_chunk(addr_t taddr, size_t len)
+{
+  if (!sba_write(taddr, len, NULL))
+    dtm_t::clear_chunk(taddr, len);
+}
+
+// Write len bytes from src (or zeros) to the target with one system bus
+// access burst: set up sbcs and sbaddress, then one sbdata0 write per word,
+// all of which can be queued back to back, and check sbcs once at the end.
+// Only used while loading the program, before any hart has run, since the
+// system bus does not go through the harts' caches. Returns false, having
+// left the debug module ready for another access, if the bus cannot be used
+// for this chunk.
+bool sim_dtm_t::sba_write(addr_t taddr, size_t len, const void* src)
+{
+  if (!sba_loading || taddr % 4 != 0 || len % 4 != 0 || len == 0)
+    return false;
+
+  if (!sba_probed) {
+    sba_probed = true;
+    uint32_t sbcs = read(DMI_SBCS);
+    if ((sbcs >> SBCS_SBVERSION_SHIFT) == 1 && (sbcs & SBCS_SBACCESS32))
+      sba_asize = (sbcs >> SBCS_SBASIZE_SHIFT) & SBCS_SBASIZE_MASK;
+  }
+  if (sba_asize == 0 || (sba_asize < 64 && ((taddr + len - 1) >> sba_asize) != 0))
+    return false;
+
+  write(DMI_SBCS, SBCS_SBBUSYERROR | SBCS_SBERROR | SBCS_SBACCESS_32 | SBCS_SBAUTOINCREMENT);
+  if (sba_asize > 32)
+    write(DMI_SBADDRESS1, (uint32_t)(taddr >> 32));
+  write(DMI_SBADDRESS0, (uint32_t)taddr);
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(src);
+  for (size_t i = 0; i < len; i += 4) {
+    uint32_t word = 0;
+    if (bytes)
+      memcpy(&word, bytes + i, sizeof(word));
+    write(DMI_SBDATA0, word);
+  }
+
+  uint32_t sbcs;
+  do {
+    sbcs = read(DMI_SBCS);
+  } while (sbcs & SBCS_SBBUSY);
+
+  if (sbcs & (SBCS_SBBUSYERROR | SBCS_SBERROR)) {
+    // Words written while the bus was busy were dropped. Clear the error
+    // and leave the rest of the load to abstract commands.
+    write(DMI_SBCS, SBCS_SBBUSYERROR | SBCS_SBERROR);
+    sba_asize = 0;
+    return false;
+  }
+  return true;
+}
+
 extern "C" int debug_tick
 (
   unsigned char* debug_req_valid,
@@ -16,32 +318,40 @@ extern "C" int debug_tick
   unsigned char  debug_resp_valid,
   unsigned char* debug_resp_ready,
   int            debug_resp_bits_resp,
-  int            debug_resp_bits_data
+  int            debug_resp_bits_data,
+  int*           debug_wait,
+  int*           debug_skip
 )
 {
+  sim_stats_timer_t timer(sim_stats_dpi_ns);
+
   if (!dtm) {
     s_vpi_vlog_info info;
     if (!vpi_get_vlog_info(&info))
       abort();
-      dtm = new dtm_t(info.argc, info.argv);
+      dtm = new sim_dtm_t(info.argc, info.argv);
   }
 
   dtm_t::resp resp_bits;
   resp_bits.resp = debug_resp_bits_resp;
   resp_bits.data = debug_resp_bits_data;
 
-  dtm->tick
+  dtm_tick_logged
   (
     debug_req_ready,
     debug_resp_valid,
     resp_bits
   );
 
-  *debug_resp_ready = dtm->resp_ready();
-  *debug_req_valid = dtm->req_valid();
-  *debug_req_bits_addr = dtm->req_bits().addr;
-  *debug_req_bits_op = dtm->req_bits().op;
-  *debug_req_bits_data = dtm->req_bits().data;
+  *debug_resp_ready = 1;
+  *debug_req_valid = dmi_req_on_pins;
+  if (dmi_req_on_pins) {
+    *debug_req_bits_addr = dmi_unsent.front().req.addr;
+    *debug_req_bits_op = dmi_unsent.front().req.op;
+    *debug_req_bits_data = dmi_unsent.front().req.data;
+  }
+  *debug_wait = dtm_wait();
+  *debug_skip = dmi_skip;
 
   return dtm->done() ? (dtm->exit_code() << 1 | 1) : 0;
 }
@@ -0,0 +1,88 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef SIMDTM_H
+#define SIMDTM_H
+
+#include <fesvr/dtm.h>
+#include <stdint.h>
+#include <vector>
+
+extern dtm_t* dtm;
+
+// dtm_t that, while fesvr loads the program, writes memory with system bus
+// access bursts instead of one abstract command per word, if the debug
+// module supports them. The bursts are only worth it with a DMI queue
+// deeper than one (see dtm_set_queue_depth()), so they are not used
+// otherwise. With an idle skip (dtm_set_idle_skip()), it also waits for the
+// target between polls of tohost without calling into fesvr every cycle.
+class sim_dtm_t : public dtm_t
+{
+ public:
+  sim_dtm_t(int argc, char** argv)
+    : dtm_t(argc, argv), sba_probed(false), sba_loading(false), sba_asize(0) {}
+
+ protected:
+  void load_program() override;
+  void idle() override;
+  void write_chunk(addr_t taddr, size_t len, const void* src) override;
+  void clear_chunk(addr_t taddr, size_t len) override;
+
+ private:
+  bool sba_write(addr_t taddr, size_t len, const void* src);
+
+  bool sba_probed;
+  bool sba_loading;
+  unsigned sba_asize;
+};
+
+// Number of DMI operations SimDTM keeps outstanding. dtm_t itself waits for
+// the response to every operation; with a depth above one, SimDTM answers
+// writes on the debug module's behalf as soon as it has queued them, so
+// dtm_t can go on to the next operation while they are still on their way.
+// Operations reach the debug module in the order dtm_t issued them, and a
+// read is only answered with the debug module's response, so dtm_t sees the
+// same results either way; a write the debug module fails aborts the run,
+// as it would in dtm_t. A depth of one gives the plain one-at-a-time
+// handshake. Either way the queue is SimDTM's: on the pins, an operation
+// is only sent once the one before it has been answered, since DMIToTL
+// cannot tell two requests in flight apart. Must be set before the first
+// debug_tick.
+void dtm_set_queue_depth(unsigned depth);
+unsigned dtm_queue_depth();
+
+// Instead of dtm_t's train of DMI NOPs between polls of tohost, answer one
+// NOP on the debug module's behalf and have SimDTM.v skip debug_tick for
+// cycles cycles (its debug_skip). Faster, but it changes when tohost is
+// polled, and so the cycle a run ends on; 0, the default, keeps dtm_t's
+// idling, which is cycle-exact. Must be set before the first debug_tick.
+void dtm_set_idle_skip(unsigned cycles);
+unsigned dtm_idle_skip();
+
+// A run of identical debug_tick inputs.
+//
+// dtm_t keeps its HTIF session on a private coroutine stack, so it cannot be
+// serialized directly. Instead, the inputs SimDTM has been given are logged
+// and replayed into a freshly constructed dtm_t, with the same queue depth,
+// which brings it back to the same state (see emulator.cc,
+// --restore-checkpoint). The replay repeats the host side of the session
+// too: every system call the target proxied through fesvr runs again.
+struct dtm_tick_run_t
+{
+  uint64_t count;
+  uint32_t data;
+  uint8_t  resp;
+  uint8_t  req_ready;
+  uint8_t  resp_valid;
+};
+
+// Start or stop logging the inputs debug_tick is given.
+void dtm_set_recording(bool enable);
+
+// The inputs logged so far.
+const std::vector<dtm_tick_run_t>& dtm_tick_log();
+
+// Drive dtm through a logged input sequence. The sequence becomes the start
+// of the current log, so a restored run can be checkpointed again.
+void dtm_replay(const std::vector<dtm_tick_run_t>& log);
+
+#endif
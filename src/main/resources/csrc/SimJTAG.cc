@@ -2,6 +2,7 @@
 
 #include <cstdlib>
 #include "remote_bitbang.h"
+#include "sim_stats.h"
 
 remote_bitbang_t* jtag;
 extern "C" int jtag_tick
@@ -13,6 +14,8 @@ extern "C" int jtag_tick
  unsigned char jtag_TDO
 )
 {
+  sim_stats_timer_t timer(sim_stats_dpi_ns);
+
   if (!jtag) {
     // TODO: Pass in real port number
     jtag = new remote_bitbang_t(0);
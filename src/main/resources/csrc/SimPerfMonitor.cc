@@ -0,0 +1,158 @@
+// See LICENSE.SiFive for license details.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "SimPerfMonitor.h"
+#include "sim_stats.h"
+
+static FILE* out = NULL;
+static bool json = false;
+static uint64_t period = 0;
+static size_t samples = 0;
+static std::string header;
+
+// A sample being put together, and the last one written, of each hart.
+struct hart_t
+{
+  uint64_t cycle;
+  std::string event_names;
+  unsigned counters;
+  unsigned events;
+  std::vector<uint64_t> values;
+  uint64_t last_mcycle;
+  uint64_t last_minstret;
+};
+
+static std::vector<hart_t> harts;
+
+static hart_t& hart(int hartid)
+{
+  if ((size_t)hartid >= harts.size())
+    harts.resize(hartid + 1, hart_t());
+  return harts[hartid];
+}
+
+bool perf_sample_open(const char* filename, uint64_t p)
+{
+  out = fopen(filename, "w");
+  if (!out) {
+    fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+    return false;
+  }
+  size_t len = strlen(filename);
+  json = len >= 5 && strcmp(filename + len - 5, ".json") == 0;
+  period = p;
+  if (json)
+    fprintf(out, "{\n  \"interval\": %" PRIu64 ",\n  \"samples\": [", period);
+  return true;
+}
+
+void perf_sample_close()
+{
+  if (!out)
+    return;
+  if (!samples)
+    fprintf(stderr, "--perf-samples: no samples taken; the run was shorter "
+            "than the interval, or the model has no SimPerfMonitor "
+            "(its config needs WithSimPerfMonitor)\n");
+  if (json)
+    fprintf(out, "%s]\n}\n", samples ? "\n  " : "");
+  fclose(out);
+  out = NULL;
+  period = 0;
+}
+
+// The names of the values of a sample, in the order SimPerfMonitor gives
+// them.
+static std::vector<std::string> value_names(const hart_t& h)
+{
+  std::vector<std::string> names;
+  names.push_back("mcycle");
+  names.push_back("minstret");
+  for (unsigned i = 0; i < h.counters; i++)
+    names.push_back("mhpmcounter" + std::to_string(i + 3));
+  for (unsigned i = 0; i < h.counters; i++)
+    names.push_back("mhpmevent" + std::to_string(i + 3));
+  size_t start = 0;
+  for (unsigned i = 0; i < h.events; i++) {
+    size_t end = h.event_names.find(',', start);
+    if (end == std::string::npos)
+      end = h.event_names.size();
+    names.push_back(start < end ? h.event_names.substr(start, end - start)
+                                : "event" + std::to_string(i));
+    start = end + 1;
+  }
+  return names;
+}
+
+static void write_sample(int hartid, const hart_t& h, double ipc)
+{
+  std::vector<std::string> names = value_names(h);
+  if (json) {
+    fprintf(out, "%s\n    {\"hart\": %d, \"cycle\": %" PRIu64 ", \"ipc\": %.4f",
+            samples ? "," : "", hartid, h.cycle, ipc);
+    for (size_t i = 0; i < h.values.size() && i < names.size(); i++)
+      fprintf(out, ", \"%s\": %" PRIu64, names[i].c_str(), h.values[i]);
+    fputs("}", out);
+  } else {
+    std::string line = "hart,cycle,ipc";
+    for (auto& name : names)
+      line += "," + name;
+    if (line != header) {
+      fprintf(out, "%s\n", line.c_str());
+      header = line;
+    }
+    fprintf(out, "%d,%" PRIu64 ",%.4f", hartid, h.cycle, ipc);
+    for (auto v : h.values)
+      fprintf(out, ",%" PRIu64, v);
+    fputs("\n", out);
+  }
+  samples++;
+}
+
+extern "C" int perf_sample_tick(int hartid, long long cycle)
+{
+  if (!period)
+    return 0;
+  return (uint64_t)cycle % period == 0 ? 2 : 1;
+}
+
+extern "C" void perf_sample_start(int hartid, long long cycle,
+                                  const char* event_names, int counters,
+                                  int events)
+{
+  hart_t& h = hart(hartid);
+  h.cycle = cycle;
+  h.event_names = event_names;
+  h.counters = counters;
+  h.events = events;
+  h.values.clear();
+}
+
+extern "C" void perf_sample_value(int hartid, long long value)
+{
+  hart(hartid).values.push_back(value);
+}
+
+extern "C" void perf_sample_end(int hartid)
+{
+  sim_stats_timer_t timer(sim_stats_dpi_ns);
+  hart_t& h = hart(hartid);
+  if (!out || h.values.size() < 2)
+    return;
+  uint64_t mcycle = h.values[0];
+  uint64_t minstret = h.values[1];
+  // The program can write mcycle; an IPC across that is meaningless.
+  uint64_t cycles = mcycle - h.last_mcycle;
+  double ipc = mcycle > h.last_mcycle && minstret >= h.last_minstret ?
+               (double)(minstret - h.last_minstret) / cycles : 0;
+  write_sample(hartid, h, ipc);
+  h.last_mcycle = mcycle;
+  h.last_minstret = minstret;
+}
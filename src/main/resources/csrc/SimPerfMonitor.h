@@ -0,0 +1,25 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef SIMPERFMONITOR_H
+#define SIMPERFMONITOR_H
+
+#include <stdint.h>
+
+// Sample each core's counters every period cycles, from now until
+// perf_sample_close(), and write them to filename as a time series: CSV,
+// or JSON if filename ends in .json. The samples are taken by SimPerfMonitor
+// from the model's side of the CSRs, so the program does not see them. The
+// test harness has one per core only when the config has WithSimPerfMonitor.
+//
+// A sample of a hart has the cycles since reset, mcycle, minstret, the IPC
+// since its last sample, each mhpmcounter and the mhpmevent that selects
+// what it counts, and, whatever the mhpmevents are set to, a count of each
+// event the core can count (see rocket/Events.scala) since sampling began.
+// All but the IPC are cumulative. In CSV, a hart whose columns differ from
+// the ones before it gets a header line of its own.
+//
+// Returns false, having said why, if filename cannot be created.
+bool perf_sample_open(const char* filename, uint64_t period);
+void perf_sample_close();
+
+#endif
@@ -7,8 +7,10 @@
 // Utility for taking a raw commit log from a processor and post-processing it
 // into a diff-able format against the spike ISA simulator's commit log.
 //
-// INPUT : a raw commit log via std::cin
-// OUTPUT: a cleaned up commit log via std::cout
+// INPUT : a raw commit log via stdin, or the file named by the argument
+// OUTPUT: a cleaned up commit log via stdout, or one file per hart
+//
+// usage: comlog [-j JOBS] [--per-hart=PREFIX] [FILE]
 //
 // PROBLEM: some writebacks can occur after the commit point in a processor.
 // These partial entries will be marked as appropriate, and the writebacks will
@@ -52,6 +54,13 @@
    physical tag needs to be deleted in the final output, as the ISA simulator
    does not know or care about renamed registers.
 
+   With more than one hart, every line starts with the hart it came from,
+   "C<hartid>: ", and each hart's lines are reordered on their own, as if
+   they were a log of their own. The merged output keeps the prefixes and
+   puts the lines of all harts in the order the instructions appear in the
+   raw log. --per-hart=PREFIX instead writes each hart's cleaned log,
+   without the prefixes, to PREFIX<hartid>.
+
   // Final (cleaned up) commit log
 
   -----------------------------------------------------------
@@ -69,162 +78,686 @@
   -----------------------------------------------------------
 */
 
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <iostream>
-#include <array>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <queue>
-#include <assert.h>
+#include <string>
+#include <thread>
 #include <vector>
 
+// Logs run to many GB, so they are taken a window at a time. The lines of a
+// window are first sorted out by hart, with each job taking a slice of the
+// window, and then each hart's lines are reordered by a job of its own.
+// Lines are parsed where they lie in the input, and a line only gets copied
+// when it has to wait in the ROB behind a partial commit.
 
-// Maximum number of physical destination registers, 64 for Rocket
-const int kMaxPdst = 64;
+const size_t kWindowSize = 4 << 20;
+const size_t kOutBufSize = 1 << 20;
+// Largest hart ID and physical destination register taken as such.
+const int kMaxHart = 65535;
+const int kMaxPdst = 1 << 20;
+
+// A line of the raw log, skip bytes of which are its "C<hartid>: " prefix.
+struct Line
+{
+   const char* text;
+   uint32_t    length;
+   uint32_t    skip;
+   uint64_t    offset;              // where it starts in the raw log
+};
+
+// Returns the hart a line comes from, and the length of its prefix in
+// *skip. A line without a prefix comes from hart 0.
+static int line_hart (const char* s, size_t len, uint32_t* skip)
+{
+   *skip = 0;
+   if (len == 0 || s[0] != 'C')
+      return 0;
+
+   // Verilog pads %d out to the width of the largest value.
+   size_t i = 1;
+   while (i < len && s[i] == ' ')
+      i++;
+   size_t digits = i;
+   int hart = 0;
+   while (i < len && isdigit(s[i]) && hart <= kMaxHart)
+      hart = hart * 10 + (s[i++] - '0');
+   if (i == digits || i == len || s[i] != ':' || hart > kMaxHart)
+      return 0;
+   i++;
+   if (i < len && s[i] == ' ')
+      i++;
+   *skip = i;
+   return hart;
+}
+
+static void write_all (int fd, const char* s, size_t len)
+{
+   while (len)
+   {
+      ssize_t n = write(fd, s, len);
+      if (n < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         perror("comlog: write");
+         exit(1);
+      }
+      s += n;
+      len -= n;
+   }
+}
+
+static size_t find_char (const char* s, size_t len, char c, size_t from = 0)
+{
+   if (from >= len)
+      return len;
+   const char* hit = (const char*) memchr(s + from, c, len - from);
+   return hit ? hit - s : len;
+}
+
+static size_t find_0x (const char* s, size_t len, size_t from)
+{
+   for (size_t i = from; i + 1 < len; i++)
+   {
+      if (s[i] == '0' && s[i+1] == 'x')
+         return i;
+   }
+   return len;
+}
+
+// The pdst after the "p" at s[idx]: "p 1" and "p12" are 1 and 12. Returns
+// -1 if there are no digits.
+static int parse_pdst (const char* s, size_t len, size_t idx)
+{
+   size_t i = idx + 1;
+   while (i < len && s[i] == ' ')
+      i++;
+   if (i == len || !isdigit(s[i]))
+      return -1;
+   int pdst = 0;
+   while (i < len && isdigit(s[i]) && pdst <= kMaxPdst)
+      pdst = pdst * 10 + (s[i++] - '0');
+   return pdst;
+}
+
+static bool is_partial_commit (const char* line, size_t len)
+{
+   return len > 46 && (line[34] == 'x' || line[34] == 'f') && line[46] == 'X';
+}
+
+static bool is_instruction (const char* line)
+{
+   return !(line[0] == 'x' || line[0] == 'f');
+}
 
 // data-structures
 
-typedef struct RobEntry
+// A line held in the ROB. Its text lives in the arena; a partial commit
+// also records where its "pNN " tag and its write-back data go, relative to
+// the end of its hart prefix, and, once the write-back has been seen, the
+// data.
+struct RobEntry
 {
    bool        ready;               // is entry ready to be committed?
    int         pdst;                // the wb physical dest. register
-   std::string str;                 // the commit string to print out
-} RobEntry;
+   uint64_t    line_offset;         // where it was in the raw log
+   size_t      offset;              // the commit string, in the arena
+   size_t      length;
+   size_t      skip;                // length of its hart prefix
+   size_t      p_idx;               // where the pdst tag starts
+   size_t      data_idx;            // where the 16 data digits start
+   char        wbdata[16];          // write-back data digits
+   size_t      wbdata_length;
+};
+
+// A line of cleaned log waiting to be merged, which ends at text[end].
+struct Record
+{
+   uint64_t    line_offset;
+   size_t      end;
+};
 
-std::deque <RobEntry> rob;
+// The reordering of one hart's stream. Cleaned lines go to fd if there is
+// one, and otherwise are kept, with where they came from, for merging.
+class HartLog
+{
+ public:
+   HartLog (int hart, int fd)
+      : hart(hart), fd(fd), rob_base(0)
+   {}
+
+   // Reorder one line of this hart's stream. Returns false, leaving a
+   // description in error, if the line cannot be made sense of.
+   bool process (const Line& line)
+   {
+      const char* body = line.text + line.skip;
+      size_t len = line.length - line.skip;
+      if (len == 0)
+         return fail("empty line", line);
 
+      bool ok;
+      if (is_instruction(body))
+      {
+         ok = push(line, body, len);
+      }
+      else
+      {
+         ok = writeback(line, body, len);
+      }
 
-// maps from physical destination register to rob entry waiting on it
-//   a value of nullptr implies there is no rob entry waiting on pdst
-std::vector<RobEntry*> pdst_to_rob(kMaxPdst, nullptr);
+      // check if head of the rob is ready, commit
+      // instructions until either empty or not ready
+      commit();
+      return ok;
+   }
+
+   // Where the oldest line still waiting for its write-back was in the raw
+   // log; nothing of this hart's after it has been written yet.
+   uint64_t waiting () const
+   {
+      return rob.empty() ? UINT64_MAX : rob.front().line_offset;
+   }
 
+   void flush ()
+   {
+      if (fd >= 0)
+      {
+         write_all(fd, &text[0], text.size());
+         text.clear();
+      }
+   }
 
-// functions
+   const int hart;
+   std::string error;
 
-void push               (std::string& line);
-void commit             ();
-void writeback          (std::string& line);
-bool is_instruction     (std::string& line);
-bool is_partial_commit  (std::string& line);
-int  get_ldst           (std::string& line);
-int  get_pdst           (std::string& line);
+   // Cleaned lines yet to be merged.
+   std::vector<char> text;
+   std::vector<Record> records;
 
-// add instruction to the ROB
-// mark as "not ready" if writeback data not ready
-void push (std::string& line)
-{
-   bool is_partial = is_partial_commit(line);
+ private:
+   bool fail (const char* what, const Line& line)
+   {
+      char num[16];
+      snprintf(num, sizeof(num), "%d", hart);
+      error = std::string("hart ") + num + ": " + what + ": " +
+              std::string(line.text, line.length);
+      return false;
+   }
 
-   RobEntry rob_entry;
-   rob_entry.str   = line;
-   rob_entry.ready = !(is_partial);
-   rob_entry.pdst  = is_partial ? get_pdst(line) : 0;
-   rob.push_back(rob_entry);
+   void put (const char* s, size_t len)
+   {
+      text.insert(text.end(), s, s + len);
+   }
 
-   if (is_partial)
+   void end_line (uint64_t line_offset)
    {
-      assert (rob_entry.pdst < kMaxPdst);
-      assert (pdst_to_rob[rob_entry.pdst] == nullptr);
-      pdst_to_rob[rob_entry.pdst] = &(rob.back());
+      text.push_back('\n');
+      if (fd < 0)
+      {
+         Record r;
+         r.line_offset = line_offset;
+         r.end = text.size();
+         records.push_back(r);
+      }
+      else if (text.size() >= kOutBufSize)
+      {
+         flush();
+      }
    }
-}
 
-void commit ()
+   void write_entry (const RobEntry& e)
+   {
+      const char* str = &arena[e.offset];
+      size_t start = fd < 0 ? 0 : e.skip;
+      if (e.pdst < 0)
+      {
+         put(str + start, e.length - start);
+      }
+      else
+      {
+         // The line with its write-back data in place and the pdst tag gone.
+         const char* body = str + e.skip;
+         size_t len = e.length - e.skip;
+         size_t data_end = std::min(e.data_idx + 16, len);
+         put(str + start, e.skip - start + e.p_idx);
+         put(body + e.data_idx - 2, 2);
+         put(e.wbdata, e.wbdata_length);
+         put(body + data_end, len - data_end);
+      }
+      end_line(e.line_offset);
+   }
+
+   void commit ()
+   {
+      while (!rob.empty() && rob.front().ready)
+      {
+         write_entry(rob.front());
+         rob.pop_front();
+         rob_base++;
+      }
+      if (rob.empty())
+         arena.clear();
+   }
+
+   // add instruction to the ROB
+   // mark as "not ready" if writeback data not ready
+   bool push (const Line& line, const char* body, size_t len)
+   {
+      bool is_partial = is_partial_commit(body, len);
+
+      // Nothing to wait behind: straight out.
+      if (!is_partial && rob.empty())
+      {
+         size_t start = fd < 0 ? 0 : line.skip;
+         put(line.text + start, line.length - start);
+         end_line(line.offset);
+         return true;
+      }
+
+      RobEntry e;
+      e.line_offset = line.offset;
+      e.offset = arena.size();
+      e.length = line.length;
+      e.skip   = line.skip;
+      e.ready  = !is_partial;
+      e.pdst   = -1;
+      e.wbdata_length = 0;
+
+      if (is_partial)
+      {
+         e.p_idx = find_char(body, len, 'p');
+         e.pdst = parse_pdst(body, len, e.p_idx);
+         e.data_idx = find_0x(body, len, 32) + 2;
+         if (e.pdst < 0 || e.pdst > kMaxPdst)
+            return fail("bad pdst", line);
+         if (e.data_idx > len || e.p_idx > e.data_idx)
+            return fail("malformed partial commit", line);
+         if ((size_t) e.pdst >= pdst_to_rob.size())
+            pdst_to_rob.resize(e.pdst + 1);
+         pdst_to_rob[e.pdst].push_back(rob_base + rob.size());
+      }
+      arena.insert(arena.end(), line.text, line.text + line.length);
+      rob.push_back(e);
+      return true;
+   }
+
+   // find instruction in ROB and substitute in the writeback data
+   // and mark it as ready for commit
+   bool writeback (const Line& line, const char* body, size_t len)
+   {
+      size_t idx = find_char(body, len, 'p');
+      int pdst = parse_pdst(body, len, idx);
+
+      // search the partial queue for writeback; with more than one partial
+      // commit waiting on the same pdst, the oldest gets it
+      if (pdst < 0 || (size_t) pdst >= pdst_to_rob.size() ||
+          pdst_to_rob[pdst].empty())
+         return fail("write-back with no partial commit waiting for it", line);
+      std::vector<uint64_t>& waiting = pdst_to_rob[pdst];
+      RobEntry& e = rob[waiting.front() - rob_base];
+      waiting.erase(waiting.begin());
+
+      // mark as ready
+      e.ready = true;
+      idx = find_0x(body, len, 0);
+      if (idx == len)
+         return fail("write-back without data", line);
+      e.wbdata_length = std::min<size_t>(16, len - (idx + 2));
+      memcpy(e.wbdata, body + idx + 2, e.wbdata_length);
+      return true;
+   }
+
+   int fd;
+   std::deque<RobEntry> rob;
+   // Text of the lines in the ROB; emptied whenever the ROB is.
+   std::vector<char> arena;
+   // Sequence number of rob.front(), counting every entry ever pushed.
+   uint64_t rob_base;
+   // maps from physical destination register to the sequence numbers of
+   // the rob entries waiting on it, oldest first
+   std::vector<std::vector<uint64_t> > pdst_to_rob;
+};
+
+static unsigned jobs = 1;
+static const char* per_hart_prefix = NULL;
+
+static std::vector<HartLog*> harts;         // by hart ID
+static std::vector<HartLog*> hart_list;     // in the order they were seen
+
+// slice_lines[j][hart] is the lines of hart in the j-th slice of the window
+static std::vector<std::vector<std::vector<Line> > > slice_lines;
+
+static std::vector<char> merge_buf;
+
+// Run f(0) .. f(n-1), on up to jobs threads.
+template <typename F>
+static void run_jobs (size_t n, F f)
 {
-   while (!rob.empty() && rob.front().ready)
+   if (jobs <= 1 || n <= 1)
+   {
+      for (size_t i = 0; i < n; i++)
+         f(i);
+      return;
+   }
+
+   std::atomic<size_t> next(0);
+   std::vector<std::thread> threads;
+   for (unsigned t = 0; t < std::min<size_t>(jobs, n); t++)
    {
-      std::cout << rob.front().str << std::endl;
-      rob.pop_front();
+      threads.push_back(std::thread([&]() {
+         for (size_t i; (i = next++) < n; )
+            f(i);
+      }));
    }
+   for (auto& t : threads)
+      t.join();
 }
 
-int get_ldst (std::string& line)
+static void index_slice (std::vector<std::vector<Line> >& lines,
+                         const char* data, size_t begin, size_t end,
+                         uint64_t base)
 {
-   assert (line.length() > 46);
+   for (auto& l : lines)
+      l.clear();
 
-   int idx = line.find_first_of('x');
-   int dst = atoi(line.substr(idx+1,2).c_str());
-   return dst;
+   size_t pos = begin;
+   while (pos < end)
+   {
+      size_t nl = find_char(data, end, '\n', pos);
+      Line line;
+      line.text = data + pos;
+      line.length = nl - pos;
+      line.offset = base + pos;
+      int hart = line_hart(line.text, line.length, &line.skip);
+      if ((size_t) hart >= lines.size())
+         lines.resize(hart + 1);
+      lines[hart].push_back(line);
+      pos = nl + 1;
+   }
 }
 
-int get_pdst (std::string& line)
+static HartLog* new_hart (int hart)
 {
-   assert (line.length() > 46);
+   int fd = -1;
+   if (per_hart_prefix)
+   {
+      char name[4096];
+      snprintf(name, sizeof(name), "%s%d", per_hart_prefix, hart);
+      fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (fd < 0)
+      {
+         fprintf(stderr, "comlog: cannot create %s: %s\n", name, strerror(errno));
+         exit(1);
+      }
+   }
+   return new HartLog(hart, fd);
+}
+
+// Write out the merged lines that nothing still waiting in a ROB can come
+// before, or all of them at the end of the log.
+static void merge (bool last)
+{
+   uint64_t watermark = UINT64_MAX;
+   if (!last)
+   {
+      for (auto h : hart_list)
+         watermark = std::min(watermark, h->waiting());
+   }
+
+   typedef std::pair<uint64_t, size_t> head_t;   // line offset, hart_list index
+   std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t> > heads;
+   std::vector<size_t> done(hart_list.size(), 0);
+   for (size_t i = 0; i < hart_list.size(); i++)
+   {
+      if (!hart_list[i]->records.empty())
+         heads.push(head_t(hart_list[i]->records[0].line_offset, i));
+   }
+
+   // Take runs of lines from one hart at a time.
+   while (!heads.empty() && heads.top().first < watermark)
+   {
+      size_t i = heads.top().second;
+      heads.pop();
+      uint64_t until = heads.empty() ? watermark : std::min(watermark, heads.top().first);
+      HartLog* h = hart_list[i];
+      size_t n = done[i];
+      size_t start = n ? h->records[n-1].end : 0;
+      while (n < h->records.size() && h->records[n].line_offset < until)
+         n++;
+      size_t end = h->records[n-1].end;
+      merge_buf.insert(merge_buf.end(), &h->text[start], &h->text[0] + end);
+      if (merge_buf.size() >= kOutBufSize)
+      {
+         write_all(STDOUT_FILENO, &merge_buf[0], merge_buf.size());
+         merge_buf.clear();
+      }
+      done[i] = n;
+      if (n < h->records.size())
+         heads.push(head_t(h->records[n].line_offset, i));
+   }
 
-   int idx = line.find_first_of('p');
-   int dst = atoi(line.substr(idx+1,2).c_str());
-   return dst;
+   for (size_t i = 0; i < hart_list.size(); i++)
+   {
+      HartLog* h = hart_list[i];
+      size_t n = done[i];
+      if (n == 0)
+         continue;
+      size_t taken = h->records[n-1].end;
+      h->text.erase(h->text.begin(), h->text.begin() + taken);
+      h->records.erase(h->records.begin(), h->records.begin() + n);
+      for (auto& r : h->records)
+         r.end -= taken;
+   }
+   write_all(STDOUT_FILENO, &merge_buf[0], merge_buf.size());
+   merge_buf.clear();
 }
 
-bool is_partial_commit (std::string& line)
+// Write out what has been committed so far and, if a hart's log was
+// malformed, report it and stop.
+static void finish (bool last)
 {
-   if (line.length() > 46 && (line.at(34) == 'x' || line.at(34) == 'f') && line.at(46) == 'X')
-      return true;
+   bool failed = false;
+   for (auto h : hart_list)
+      failed |= !h->error.empty();
+
+   if (per_hart_prefix)
+   {
+      for (auto h : hart_list)
+         h->flush();
+   }
    else
-      return false;
+   {
+      merge(last);
+   }
+
+   if (failed)
+   {
+      for (auto h : hart_list)
+      {
+         if (!h->error.empty())
+            fprintf(stderr, "comlog: %s\n", h->error.c_str());
+      }
+      exit(1);
+   }
 }
 
-bool is_instruction (std::string& line)
+// Reorder the complete lines in [data, data + len), which start at base in
+// the raw log.
+static void process_window (const char* data, size_t len, uint64_t base)
 {
-   return !(line.at(0) == 'x' || line.at(0) == 'f');
+   // Cut the window into a slice per job, at line boundaries.
+   size_t slices = std::max<size_t>(1, std::min<size_t>(jobs, len / 4096));
+   std::vector<size_t> bounds(1, 0);
+   for (size_t j = 1; j < slices; j++)
+   {
+      size_t pos = std::max(bounds.back(), len / slices * j);
+      bounds.push_back(std::min(len, find_char(data, len, '\n', pos) + 1));
+   }
+   bounds.push_back(len);
+
+   if (slice_lines.size() < slices)
+      slice_lines.resize(slices);
+   run_jobs(slices, [&](size_t j) {
+      index_slice(slice_lines[j], data, bounds[j], bounds[j+1], base);
+   });
+
+   for (size_t j = 0; j < slices; j++)
+   {
+      for (size_t hart = 0; hart < slice_lines[j].size(); hart++)
+      {
+         if (slice_lines[j][hart].empty())
+            continue;
+         if (hart >= harts.size())
+            harts.resize(hart + 1);
+         if (!harts[hart])
+         {
+            harts[hart] = new_hart(hart);
+            hart_list.push_back(harts[hart]);
+         }
+      }
+   }
+
+   run_jobs(hart_list.size(), [&](size_t i) {
+      HartLog* h = hart_list[i];
+      for (size_t j = 0; j < slices && h->error.empty(); j++)
+      {
+         if ((size_t) h->hart >= slice_lines[j].size())
+            continue;
+         for (auto& line : slice_lines[j][h->hart])
+         {
+            if (!h->process(line))
+               break;
+         }
+      }
+   });
+
+   finish(false);
 }
 
-// find instruction in ROB and substitute in the writeback data
-// and mark it as ready for commit
-void writeback (std::string& line)
-{
-   assert (line.at(0) == 'x' || line.at(0) == 'f');
-
-   size_t idx = line.find_first_of('p');
-   assert (idx != std::string::npos);
-   int pdst = atoi(line.substr(idx+1,2).c_str());
-
-   // search the partial queue for writeback
-   assert (pdst < kMaxPdst);
-   RobEntry* rob_entry = pdst_to_rob[pdst];
-   assert (rob_entry != nullptr);
-   pdst_to_rob[pdst] = nullptr;
-
-   // update ROB
-   assert (rob_entry->str.length() > 32);
-   std::string* rob_str = &(rob_entry->str);
-
-   // mark as ready
-   rob_entry->ready = true;
-   idx = line.find("0x");
-   std::string wbdata = line.substr(idx+2,16);
-   idx = rob_str->find("0x",32); // actually want to find the 3rd occurrence
-   int p_idx = rob_str->find_first_of('p');
-   rob_str->replace(idx+2,16,wbdata);
-   rob_str->erase(p_idx, (idx-p_idx));
+static void usage (const char* argv0)
+{
+   fprintf(stderr, "usage: %s [-j JOBS] [--per-hart=PREFIX] [FILE]\n", argv0);
+   fprintf(stderr, "  -j, --jobs=JOBS        threads to use (default: one per CPU)\n");
+   fprintf(stderr, "  -p, --per-hart=PREFIX  write each hart's log to PREFIX<hartid>\n");
+   exit(1);
 }
 
 int main (int argc, char** argv)
 {
-   std::string line;
-
-   // check for errno
-   while (getline(std::cin, line))
+   jobs = std::max(1u, std::thread::hardware_concurrency());
+
+   static struct option long_options[] = {
+      {"jobs",     required_argument, 0, 'j'},
+      {"per-hart", required_argument, 0, 'p'},
+      {"help",     no_argument,       0, 'h'},
+      {0, 0, 0, 0}
+   };
+   int c;
+   while ((c = getopt_long(argc, argv, "j:p:h", long_options, NULL)) != -1)
    {
-      if (is_instruction(line))
+      switch (c)
       {
-         push(line);
+         case 'j':
+            jobs = std::max(1, atoi(optarg));
+            break;
+         case 'p':
+            per_hart_prefix = optarg;
+            break;
+         default:
+            usage(argv[0]);
       }
-      else
+   }
+   if (argc - optind > 1)
+      usage(argv[0]);
+
+   int fd = STDIN_FILENO;
+   if (optind < argc)
+   {
+      fd = open(argv[optind], O_RDONLY);
+      if (fd < 0)
       {
-         writeback(line);
+         fprintf(stderr, "comlog: cannot open %s: %s\n", argv[optind], strerror(errno));
+         return 1;
       }
-
-      // check if head of the rob is ready, commit
-      // instructions until either empty or not ready
-      commit();
    }
 
-   if (std::cin.bad())
+   // A regular file is mapped whole; anything else is read a window at a
+   // time, carrying a partial last line over to the next one. A last line
+   // with no newline still counts, as it did with getline().
+   struct stat st;
+   if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
    {
-      // IO error
-      std::cout << "\nIO ERROR: cin.bad()\n\n";
-      return 1;
+      void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+      {
+         madvise(map, st.st_size, MADV_SEQUENTIAL);
+         const char* data = (const char*) map;
+         size_t size = st.st_size;
+         size_t pos = 0;
+         while (pos < size)
+         {
+            size_t end = pos + std::min(kWindowSize, size - pos);
+            end = std::min(size, find_char(data, size, '\n', end - 1) + 1);
+            process_window(data + pos, end - pos, pos);
+            pos = end;
+         }
+         finish(true);
+         return 0;
+      }
    }
 
+   std::vector<char> buf(kWindowSize);
+   size_t have = 0;
+   uint64_t base = 0;
+   bool eof = false;
+   while (!eof)
+   {
+      if (have == buf.size())
+         buf.resize(buf.size() * 2);
+      ssize_t n = read(fd, &buf[have], buf.size() - have);
+      if (n < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         // IO error
+         finish(true);
+         fprintf(stderr, "\nIO ERROR: %s\n\n", strerror(errno));
+         return 1;
+      }
+      eof = n == 0;
+      have += n;
+      if (have < buf.size() && !eof)
+         continue;
+
+      size_t len = have;
+      if (!eof)
+      {
+         const char* last = (const char*) memrchr(&buf[0], '\n', have);
+         if (!last)
+            continue;
+         len = last - &buf[0] + 1;
+      }
+      if (len)
+         process_window(&buf[0], len, base);
+      memmove(&buf[0], &buf[len], have - len);
+      have -= len;
+      base += len;
+   }
+   finish(true);
    return 0;
 }
-
@@ -0,0 +1,437 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef COMMIT_LOG_H
+#define COMMIT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// Binary form of the commit log Rocket prints under +verbose when it is
+// built with enableCommitLog (see RocketCore.scala and FPU.scala). The
+// emulator writes it through SimCommitLog with --commit-log=FILE;
+// commit_log_encode turns a text log into one, and commit_log_decode prints
+// one as text, either exactly as the printfs would have or reordered the
+// way comlog does.
+//
+// A file is a commit_log_header_t followed by records. A record starts with
+// a byte whose low two bits give its kind:
+//
+//   COMMIT     an instruction retired; bit 2 set if its PC is 4 past the
+//              previous one of the same hart, bit 3 if it writes a
+//              register, bit 4 if that is an FP register, bit 5 if the value
+//              comes in a later WRITEBACK (a partial commit), bit 6 if the
+//              instruction is stored in 2 bytes, bit 7 if the value is
+//              stored in 4. Then a byte holding the privilege mode in bits
+//              0-2 and rd in bits 3-7, the PC (unless bit 2) as a zigzag
+//              varint delta from the previous one, the instruction, and if
+//              it writes a register, the pdst as a varint for a partial
+//              commit or else the value.
+//   WRITEBACK  a value for a partial commit; bit 4 and bit 7 as above. Then
+//              a byte holding rd, the pdst as a varint, and the value.
+//   HART       the records that follow are from the hart given by a varint.
+//   TEXT       a line that is not part of the commit log, given by a varint
+//              length and the bytes, without the newline.
+//
+// Numbers are little-endian. Records are from hart 0 until the first HART.
+
+#define COMMIT_LOG_MAGIC "RCLB"
+#define COMMIT_LOG_VERSION 1
+
+// How wide the printfs print each field: %d pads with spaces and %x with
+// zeros to the width of the largest value of the signal.
+struct commit_log_header_t
+{
+  char magic[4];
+  uint8_t version;
+  uint8_t hart_digits;    // 0: no "C<hartid>: " prefix
+  uint8_t priv_digits;
+  uint8_t pc_digits;
+  uint8_t insn_digits;
+  uint8_t rd_digits;
+  uint8_t pdst_digits;
+  uint8_t xdata_digits;
+  uint8_t fdata_digits;
+  uint8_t reserved[3];
+};
+
+enum {
+  COMMIT_LOG_COMMIT = 0,
+  COMMIT_LOG_WRITEBACK = 1,
+  COMMIT_LOG_HART = 2,
+  COMMIT_LOG_TEXT = 3,
+};
+
+enum {
+  COMMIT_LOG_SEQ_PC = 1 << 2,
+  COMMIT_LOG_HAS_RD = 1 << 3,
+  COMMIT_LOG_FP = 1 << 4,
+  COMMIT_LOG_PARTIAL = 1 << 5,
+  COMMIT_LOG_SHORT_INSN = 1 << 6,
+  COMMIT_LOG_SHORT_DATA = 1 << 7,
+};
+
+struct commit_log_record_t
+{
+  int kind;
+  uint32_t hart;
+  uint8_t priv;
+  bool has_rd;
+  bool fp;
+  bool partial;
+  uint8_t rd;
+  uint32_t pdst;
+  uint64_t pc;
+  uint32_t insn;
+  uint64_t data;
+  const char* text;       // TEXT only
+  size_t text_len;
+};
+
+// Field widths for signals of the given widths in bits: hex digits for %x,
+// decimal digits for %d.
+static inline uint8_t commit_log_hex_digits(int bits)
+{
+  return (bits + 3) / 4;
+}
+
+static inline uint8_t commit_log_dec_digits(int bits)
+{
+  if (bits <= 0)
+    return 0;
+  uint64_t max = bits >= 64 ? UINT64_MAX : (UINT64_C(1) << bits) - 1;
+  uint8_t digits = 1;
+  while (max >= 10) {
+    max /= 10;
+    digits++;
+  }
+  return digits;
+}
+
+static inline void commit_log_header_init(commit_log_header_t* h, int hartid_bits,
+                                          int pc_bits, int xlen, int flen)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, COMMIT_LOG_MAGIC, 4);
+  h->version = COMMIT_LOG_VERSION;
+  h->hart_digits = commit_log_dec_digits(hartid_bits);
+  h->priv_digits = commit_log_dec_digits(3);
+  h->pc_digits = commit_log_hex_digits(pc_bits);
+  h->insn_digits = commit_log_hex_digits(32);
+  h->rd_digits = commit_log_dec_digits(5);
+  h->pdst_digits = commit_log_dec_digits(6);
+  h->xdata_digits = commit_log_hex_digits(xlen);
+  h->fdata_digits = commit_log_hex_digits(flen ? flen : xlen);
+}
+
+static inline bool commit_log_header_valid(const commit_log_header_t& h)
+{
+  return memcmp(h.magic, COMMIT_LOG_MAGIC, 4) == 0 && h.version == COMMIT_LOG_VERSION;
+}
+
+// Encodes records, keeping track of the current hart and each hart's PC.
+class commit_log_encoder_t
+{
+ public:
+  commit_log_encoder_t() : hart(0) {}
+
+  // The most a record other than TEXT takes, HART record included.
+  static const size_t max_record_size = 32;
+
+  // Append the encoding of r to out.
+  void encode(const commit_log_record_t& r, std::vector<char>& out)
+  {
+    char buf[max_record_size];
+    char* p = buf;
+    if (r.hart != hart) {
+      hart = r.hart;
+      *p++ = COMMIT_LOG_HART;
+      p = put_varint(p, hart);
+    }
+    if (hart >= last_pc.size())
+      last_pc.resize(hart + 1, 0);
+
+    switch (r.kind) {
+      case COMMIT_LOG_COMMIT: {
+        uint8_t* head = (uint8_t*)p;
+        *p++ = COMMIT_LOG_COMMIT;
+        *p++ = (r.priv & 7) | r.rd << 3;
+        uint64_t& pc = last_pc[hart];
+        if (r.pc == pc + 4)
+          *head |= COMMIT_LOG_SEQ_PC;
+        else
+          p = put_varint(p, zigzag(r.pc - pc));
+        pc = r.pc;
+        if (r.insn <= 0xffff) {
+          *head |= COMMIT_LOG_SHORT_INSN;
+          p = put_le(p, r.insn, 2);
+        } else {
+          p = put_le(p, r.insn, 4);
+        }
+        if (r.has_rd) {
+          *head |= COMMIT_LOG_HAS_RD | (r.fp ? COMMIT_LOG_FP : 0);
+          if (r.partial) {
+            *head |= COMMIT_LOG_PARTIAL;
+            p = put_varint(p, r.pdst);
+          } else {
+            p = put_data(p, head, r.data);
+          }
+        }
+        break;
+      }
+      case COMMIT_LOG_WRITEBACK: {
+        uint8_t* head = (uint8_t*)p;
+        *p++ = COMMIT_LOG_WRITEBACK | (r.fp ? COMMIT_LOG_FP : 0);
+        *p++ = r.rd;
+        p = put_varint(p, r.pdst);
+        p = put_data(p, head, r.data);
+        break;
+      }
+      case COMMIT_LOG_TEXT:
+        *p++ = COMMIT_LOG_TEXT;
+        p = put_varint(p, r.text_len);
+        out.insert(out.end(), buf, p);
+        out.insert(out.end(), r.text, r.text + r.text_len);
+        return;
+    }
+    out.insert(out.end(), buf, p);
+  }
+
+ private:
+  static uint64_t zigzag(uint64_t delta)
+  {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+  }
+
+  static char* put_varint(char* p, uint64_t x)
+  {
+    while (x >= 0x80) {
+      *p++ = (char)(x | 0x80);
+      x >>= 7;
+    }
+    *p++ = (char)x;
+    return p;
+  }
+
+  static char* put_le(char* p, uint64_t x, int bytes)
+  {
+    for (int i = 0; i < bytes; i++)
+      *p++ = (char)(x >> (8 * i));
+    return p;
+  }
+
+  static char* put_data(char* p, uint8_t* head, uint64_t data)
+  {
+    if (data <= 0xffffffff) {
+      *head |= COMMIT_LOG_SHORT_DATA;
+      return put_le(p, data, 4);
+    }
+    return put_le(p, data, 8);
+  }
+
+  uint32_t hart;
+  std::vector<uint64_t> last_pc;
+};
+
+// Decodes the records that follow the header.
+class commit_log_decoder_t
+{
+ public:
+  commit_log_decoder_t() : hart(0) {}
+
+  // Decode the record at p into r, and return the one after it, or NULL,
+  // having changed nothing, if the record is cut off or malformed.
+  const char* decode(const char* p, const char* end, commit_log_record_t* r)
+  {
+    uint32_t hart = this->hart;
+    while (p < end && (*p & 3) == COMMIT_LOG_HART) {
+      uint64_t h;
+      if (!(p = get_varint(p + 1, end, &h)))
+        return NULL;
+      hart = h;
+    }
+    if (p >= end)
+      return NULL;
+    if (hart >= last_pc.size())
+      last_pc.resize(hart + 1, 0);
+
+    uint8_t head = *p++;
+    r->kind = head & 3;
+    r->hart = hart;
+    r->fp = head & COMMIT_LOG_FP;
+    r->partial = false;
+    r->has_rd = false;
+    r->text = NULL;
+    r->text_len = 0;
+    uint64_t x;
+    switch (r->kind) {
+      case COMMIT_LOG_COMMIT: {
+        if (p >= end)
+          return NULL;
+        r->priv = *p & 7;
+        r->rd = (uint8_t)*p++ >> 3;
+        uint64_t pc = last_pc[hart];
+        if (head & COMMIT_LOG_SEQ_PC) {
+          pc += 4;
+        } else {
+          if (!(p = get_varint(p, end, &x)))
+            return NULL;
+          pc += (x >> 1) ^ -(x & 1);
+        }
+        r->pc = pc;
+        if (!(p = get_le(p, end, head & COMMIT_LOG_SHORT_INSN ? 2 : 4, &x)))
+          return NULL;
+        r->insn = x;
+        r->has_rd = head & COMMIT_LOG_HAS_RD;
+        r->partial = head & COMMIT_LOG_PARTIAL;
+        r->pdst = 0;
+        r->data = 0;
+        if (r->has_rd && r->partial) {
+          if (!(p = get_varint(p, end, &x)))
+            return NULL;
+          r->pdst = x;
+        } else if (r->has_rd) {
+          if (!(p = get_le(p, end, head & COMMIT_LOG_SHORT_DATA ? 4 : 8, &r->data)))
+            return NULL;
+        }
+        last_pc[hart] = pc;
+        break;
+      }
+      case COMMIT_LOG_WRITEBACK:
+        if (p >= end)
+          return NULL;
+        r->rd = *p++;
+        if (!(p = get_varint(p, end, &x)))
+          return NULL;
+        r->pdst = x;
+        if (!(p = get_le(p, end, head & COMMIT_LOG_SHORT_DATA ? 4 : 8, &r->data)))
+          return NULL;
+        break;
+      default:
+        if (!(p = get_varint(p, end, &x)) || x > (uint64_t)(end - p))
+          return NULL;
+        r->text = p;
+        r->text_len = x;
+        p += x;
+        break;
+    }
+    this->hart = hart;
+    return p;
+  }
+
+ private:
+  static const char* get_varint(const char* p, const char* end, uint64_t* x)
+  {
+    *x = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+      uint8_t b = *p++;
+      *x |= (uint64_t)(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return p;
+    }
+    return NULL;
+  }
+
+  static const char* get_le(const char* p, const char* end, int bytes, uint64_t* x)
+  {
+    if (end - p < bytes)
+      return NULL;
+    *x = 0;
+    for (int i = 0; i < bytes; i++)
+      *x |= (uint64_t)(uint8_t)p[i] << (8 * i);
+    return p + bytes;
+  }
+
+  uint32_t hart;
+  std::vector<uint64_t> last_pc;
+};
+
+// Prints records as the printfs do.
+class commit_log_printer_t
+{
+ public:
+  explicit commit_log_printer_t(const commit_log_header_t& h) : h(h) {}
+
+  // Append the text of r, without the newline, to out. A partial commit
+  // whose WRITEBACK is given comes out with the value in place and no pdst,
+  // as comlog leaves it.
+  void print(const commit_log_record_t& r, std::string& out,
+             const commit_log_record_t* writeback = NULL) const
+  {
+    if (r.kind == COMMIT_LOG_TEXT) {
+      out.append(r.text, r.text_len);
+      return;
+    }
+    if (h.hart_digits) {
+      out += 'C';
+      dec(out, r.hart, h.hart_digits);
+      out += ": ";
+    }
+    if (r.kind == COMMIT_LOG_WRITEBACK) {
+      out += r.fp ? 'f' : 'x';
+      dec(out, r.rd, h.rd_digits);
+      out += " p";
+      dec(out, r.pdst, h.pdst_digits);
+      out += " 0x";
+      hex(out, r.data, r.fp ? h.fdata_digits : h.xdata_digits);
+      return;
+    }
+
+    dec(out, r.priv, h.priv_digits);
+    out += " 0x";
+    hex(out, r.pc, h.pc_digits);
+    out += " (0x";
+    hex(out, r.insn, h.insn_digits);
+    out += ')';
+    if (!r.has_rd)
+      return;
+    out += ' ';
+    out += r.fp ? 'f' : 'x';
+    dec(out, r.rd, h.rd_digits);
+    if (r.partial && writeback) {
+      // comlog takes at most 16 digits of the write-back.
+      out += " 0x";
+      size_t digits = writeback->fp ? h.fdata_digits : h.xdata_digits;
+      size_t start = out.size();
+      hex(out, writeback->data, digits);
+      if (digits > 16)
+        out.resize(start + 16);
+    } else if (r.partial) {
+      out += " p";
+      dec(out, r.pdst, h.pdst_digits);
+      out += " 0xXXXXXXXXXXXXXXXX";
+    } else {
+      out += " 0x";
+      hex(out, r.data, r.fp ? h.fdata_digits : h.xdata_digits);
+    }
+  }
+
+ private:
+  static void dec(std::string& out, uint64_t x, int width)
+  {
+    char buf[24];
+    int n = 0;
+    do {
+      buf[n++] = '0' + x % 10;
+      x /= 10;
+    } while (x);
+    for (int i = n; i < width; i++)
+      out += ' ';
+    while (n)
+      out += buf[--n];
+  }
+
+  static void hex(std::string& out, uint64_t x, int width)
+  {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = width - 1; i >= 0; i--)
+      out += i < 16 ? digits[(x >> (4 * i)) & 15] : '0';
+  }
+
+  commit_log_header_t h;
+};
+
+#endif
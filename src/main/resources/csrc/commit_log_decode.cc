@@ -0,0 +1,320 @@
+// See LICENSE.SiFive for license details.
+
+// commit_log_decode: print a binary commit log (see commit_log.h) as text
+//
+// usage: commit_log_decode [--raw] [--fix-fld=SPIKE_LOG] [LOG]
+//
+// By default the log comes out as comlog would clean up its text: each
+// partial commit gets the value of its write-back in place of its pdst, the
+// write-backs themselves are left out, and each hart's instructions stay in
+// the order they were committed, which holds back everything of a hart
+// behind a partial commit until its write-back arrives. With --raw every
+// record is printed exactly as the printfs did, write-backs included.
+//
+// --fix-fld=SPIKE_LOG does what float_fix does to the output, against the
+// given spike log, line by line: a line writing an FP register that differs
+// from spike's gets the single float its value holds unrecoded, if that
+// makes them match.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "commit_log.h"
+#include "float_fix.h"
+
+static const size_t kBufSize = 1 << 20;
+
+static std::string out;
+static FILE* spike = NULL;
+static std::string spike_line;
+static uint64_t fixed_lines = 0;
+
+static void write_all(const char* p, size_t len)
+{
+  while (len) {
+    ssize_t n = write(STDOUT_FILENO, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      perror("commit_log_decode: write");
+      exit(1);
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+static void flush()
+{
+  write_all(out.data(), out.size());
+  out.clear();
+}
+
+// Finish the line that starts at out[start]. fp_rd says whether it writes an
+// FP register, and so is one float_fix would look at.
+static void end_line(size_t start, bool fp_rd)
+{
+  if (spike) {
+    spike_line.clear();
+    int c;
+    while ((c = getc(spike)) != EOF && c != '\n')
+      spike_line += (char)c;
+    if (fp_rd) {
+      std::string line(out, start);
+      if (FixLine(&line, spike_line)) {
+        out.replace(start, std::string::npos, line);
+        fixed_lines++;
+      }
+    }
+  }
+  out += '\n';
+  if (out.size() >= kBufSize)
+    flush();
+}
+
+// A record waiting to be printed in comlog order.
+struct entry_t
+{
+  commit_log_record_t r;
+  commit_log_record_t wb;
+  bool ready;
+  std::string text;     // a TEXT record's line, which r.text does not outlive
+};
+
+class reorderer_t
+{
+ public:
+  explicit reorderer_t(const commit_log_header_t& h) : printer(h), base(0) {}
+
+  // Take one record; false if it is a write-back nothing is waiting for.
+  bool add(const commit_log_record_t& r)
+  {
+    if (r.kind == COMMIT_LOG_WRITEBACK) {
+      std::deque<uint64_t>& q = waiting[key(r)];
+      if (q.empty())
+        return false;
+      entry_t& e = rob[q.front() - base];
+      q.pop_front();
+      e.wb = r;
+      e.ready = true;
+      commit();
+      return true;
+    }
+
+    bool partial = r.kind == COMMIT_LOG_COMMIT && r.has_rd && r.partial;
+    if (!partial && rob.empty()) {
+      print(r, NULL);
+      return true;
+    }
+    rob.push_back(entry_t());
+    entry_t& e = rob.back();
+    e.r = r;
+    e.ready = !partial;
+    if (r.kind == COMMIT_LOG_TEXT) {
+      e.text.assign(r.text, r.text_len);
+      e.r.text = NULL;
+    }
+    if (partial)
+      waiting[key(r)].push_back(base + rob.size() - 1);
+    return true;
+  }
+
+  // Print what is left, leaving each hart at its first partial commit that
+  // never got its write-back.
+  void finish()
+  {
+    std::set<uint32_t> blocked;
+    for (size_t i = 0; i < rob.size(); i++) {
+      entry_t& e = rob[i];
+      if (blocked.count(e.r.hart))
+        continue;
+      if (!e.ready)
+        blocked.insert(e.r.hart);
+      else
+        print_entry(e);
+    }
+    rob.clear();
+  }
+
+ private:
+  static std::pair<uint32_t, uint32_t> key(const commit_log_record_t& r)
+  {
+    return std::make_pair(r.hart, r.pdst);
+  }
+
+  void print(const commit_log_record_t& r, const commit_log_record_t* wb)
+  {
+    size_t start = out.size();
+    printer.print(r, out, wb);
+    end_line(start, r.kind == COMMIT_LOG_COMMIT && r.has_rd && r.fp);
+  }
+
+  void print_entry(entry_t& e)
+  {
+    if (e.r.kind == COMMIT_LOG_TEXT) {
+      e.r.text = e.text.data();
+      e.r.text_len = e.text.size();
+    }
+    print(e.r, e.r.partial ? &e.wb : NULL);
+  }
+
+  void commit()
+  {
+    while (!rob.empty() && rob.front().ready) {
+      print_entry(rob.front());
+      rob.pop_front();
+      base++;
+    }
+  }
+
+  commit_log_printer_t printer;
+  std::deque<entry_t> rob;
+  uint64_t base;        // sequence number of rob.front()
+  // The partial commits waiting on each hart's pdst, oldest first.
+  std::map<std::pair<uint32_t, uint32_t>, std::deque<uint64_t> > waiting;
+};
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr, "usage: %s [--raw] [--fix-fld=SPIKE_LOG] [LOG]\n", argv0);
+  fprintf(stderr, "  -r, --raw                print every record as the printfs did\n");
+  fprintf(stderr, "  -f, --fix-fld=SPIKE_LOG  unrecode FP values as float_fix does\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  bool raw = false;
+  const char* spike_log = NULL;
+
+  static struct option long_options[] = {
+    {"raw",     no_argument,       0, 'r'},
+    {"fix-fld", required_argument, 0, 'f'},
+    {"help",    no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "rf:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'r':
+        raw = true;
+        break;
+      case 'f':
+        spike_log = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind > 1)
+    usage(argv[0]);
+
+  int fd = STDIN_FILENO;
+  if (optind < argc && strcmp(argv[optind], "-") != 0) {
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "commit_log_decode: cannot open %s: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+  }
+  if (spike_log && !(spike = fopen(spike_log, "r"))) {
+    fprintf(stderr, "commit_log_decode: cannot open %s: %s\n", spike_log, strerror(errno));
+    return 1;
+  }
+
+  // Read a buffer at a time, carrying a record cut off at its end over to
+  // the next one.
+  std::vector<char> buf(kBufSize);
+  size_t have = 0;
+  bool eof = false;
+  bool have_header = false;
+  commit_log_header_t h;
+  commit_log_decoder_t decoder;
+  reorderer_t* rob = NULL;
+  out.reserve(kBufSize + 256);
+
+  while (!eof || have) {
+    if (!eof) {
+      if (have == buf.size())
+        buf.resize(buf.size() * 2);
+      ssize_t n = read(fd, &buf[have], buf.size() - have);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0) {
+        perror("commit_log_decode: read");
+        return 1;
+      }
+      if (n == 0)
+        eof = true;
+      have += n;
+    }
+
+    const char* p = buf.data();
+    const char* end = p + have;
+    if (!have_header) {
+      if (have < sizeof(h)) {
+        if (!eof)
+          continue;
+        fprintf(stderr, "commit_log_decode: not a binary commit log\n");
+        return 1;
+      }
+      memcpy(&h, p, sizeof(h));
+      if (!commit_log_header_valid(h)) {
+        fprintf(stderr, "commit_log_decode: not a binary commit log\n");
+        return 1;
+      }
+      have_header = true;
+      rob = new reorderer_t(h);
+      p += sizeof(h);
+    }
+
+    commit_log_printer_t printer(h);
+    commit_log_record_t r;
+    const char* next;
+    while ((next = decoder.decode(p, end, &r))) {
+      p = next;
+      if (raw) {
+        size_t start = out.size();
+        printer.print(r, out);
+        end_line(start, r.kind != COMMIT_LOG_TEXT && r.has_rd && r.fp);
+      } else if (!rob->add(r)) {
+        rob->finish();
+        flush();
+        std::string line;
+        printer.print(r, line);
+        fprintf(stderr, "commit_log_decode: write-back with no partial commit waiting for it: %s\n",
+                line.c_str());
+        return 1;
+      }
+    }
+
+    have = end - p;
+    memmove(buf.data(), p, have);
+    if (eof && have) {
+      if (!raw)
+        rob->finish();
+      flush();
+      fprintf(stderr, "commit_log_decode: log ends in the middle of a record\n");
+      return 1;
+    }
+  }
+
+  if (rob && !raw)
+    rob->finish();
+  flush();
+  if (fixed_lines)
+    fprintf(stderr, "commit_log_decode: unrecoded %llu FP values\n",
+            (unsigned long long)fixed_lines);
+  return 0;
+}
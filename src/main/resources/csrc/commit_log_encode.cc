@@ -0,0 +1,299 @@
+// See LICENSE.SiFive for license details.
+
+// commit_log_encode: turn a raw text commit log, as Rocket prints it under
+// +verbose, into the binary format of commit_log.h
+//
+// usage: commit_log_encode [FILE] > LOG
+//
+// The field widths are taken from the log itself. Every line is checked by
+// printing the record it was read as; one that does not come out the same,
+// such as the output of some other printf, is kept as a TEXT record, so that
+// commit_log_decode --raw gives back exactly the input.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "commit_log.h"
+
+// Field widths seen in a line, 0 for fields it does not have.
+struct widths_t
+{
+  int hart, priv, pc, insn, rd, pdst, xdata, fdata;
+};
+
+// A cursor over one line.
+struct cursor_t
+{
+  const char* p;
+  const char* end;
+
+  bool eat(const char* s)
+  {
+    size_t n = strlen(s);
+    if ((size_t)(end - p) < n || memcmp(p, s, n) != 0)
+      return false;
+    p += n;
+    return true;
+  }
+
+  // A %d field: spaces, then digits. Sets *width to the length of both.
+  bool dec(uint64_t* x, int* width)
+  {
+    const char* start = p;
+    while (p < end && *p == ' ')
+      p++;
+    if (p == end || *p < '0' || *p > '9')
+      return false;
+    *x = 0;
+    while (p < end && *p >= '0' && *p <= '9' && p - start < 20)
+      *x = *x * 10 + (*p++ - '0');
+    *width = p - start;
+    return true;
+  }
+
+  // A %x field, of at most 16 digits.
+  bool hex(uint64_t* x, int* width)
+  {
+    const char* start = p;
+    *x = 0;
+    while (p < end && p - start < 16) {
+      char c = *p;
+      int d = c >= '0' && c <= '9' ? c - '0' :
+              c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+      if (d < 0)
+        break;
+      *x = *x << 4 | d;
+      p++;
+    }
+    *width = p - start;
+    return p > start;
+  }
+};
+
+// Read a line as a record, noting the widths of its fields.
+static bool parse_line(const char* line, size_t len, commit_log_record_t* r, widths_t* w)
+{
+  memset(r, 0, sizeof(*r));
+  memset(w, 0, sizeof(*w));
+  cursor_t c = { line, line + len };
+  uint64_t x;
+  int width;
+
+  if (c.eat("C")) {
+    if (!c.dec(&x, &w->hart) || !c.eat(": "))
+      return false;
+    r->hart = x;
+  }
+
+  if (c.p < c.end && (*c.p == 'x' || *c.p == 'f')) {
+    r->kind = COMMIT_LOG_WRITEBACK;
+    r->fp = *c.p++ == 'f';
+    if (!c.dec(&x, &w->rd))
+      return false;
+    r->rd = x;
+    if (!c.eat(" p") || !c.dec(&x, &width) || !c.eat(" 0x"))
+      return false;
+    w->pdst = width;
+    r->pdst = x;
+    if (!c.hex(&r->data, r->fp ? &w->fdata : &w->xdata))
+      return false;
+    return c.p == c.end;
+  }
+
+  r->kind = COMMIT_LOG_COMMIT;
+  if (!c.dec(&x, &w->priv) || !c.eat(" 0x"))
+    return false;
+  r->priv = x;
+  if (!c.hex(&r->pc, &w->pc) || !c.eat(" (0x"))
+    return false;
+  if (!c.hex(&x, &w->insn) || !c.eat(")"))
+    return false;
+  r->insn = x;
+  if (c.p == c.end)
+    return true;
+
+  if (!c.eat(" ") || c.p == c.end || (*c.p != 'x' && *c.p != 'f'))
+    return false;
+  r->has_rd = true;
+  r->fp = *c.p++ == 'f';
+  if (!c.dec(&x, &w->rd))
+    return false;
+  r->rd = x;
+  if (c.eat(" p")) {
+    r->partial = true;
+    if (!c.dec(&x, &w->pdst) || !c.eat(" 0xXXXXXXXXXXXXXXXX"))
+      return false;
+    r->pdst = x;
+  } else {
+    if (!c.eat(" 0x") || !c.hex(&r->data, r->fp ? &w->fdata : &w->xdata))
+      return false;
+  }
+  return c.p == c.end;
+}
+
+static void set_width(uint8_t* field, int width)
+{
+  if (!*field && width)
+    *field = width;
+}
+
+// Take the widths of each field from the first line that has it.
+static void find_widths(const char* data, size_t size, commit_log_header_t* h)
+{
+  commit_log_header_init(h, 0, 64, 64, 64);
+  uint8_t* fields[] = { &h->hart_digits, &h->priv_digits, &h->pc_digits,
+                        &h->insn_digits, &h->rd_digits, &h->pdst_digits,
+                        &h->xdata_digits, &h->fdata_digits };
+  uint8_t defaults[8];
+  for (int i = 0; i < 8; i++) {
+    defaults[i] = *fields[i];
+    *fields[i] = 0;
+  }
+
+  for (size_t pos = 0; pos < size; ) {
+    const char* nl = (const char*)memchr(data + pos, '\n', size - pos);
+    size_t end = nl ? nl - data : size;
+    commit_log_record_t r;
+    widths_t w;
+    if (parse_line(data + pos, end - pos, &r, &w)) {
+      int widths[] = { w.hart, w.priv, w.pc, w.insn, w.rd, w.pdst, w.xdata, w.fdata };
+      bool done = true;
+      for (int i = 0; i < 8; i++) {
+        set_width(fields[i], widths[i]);
+        done &= *fields[i] != 0;
+      }
+      if (done)
+        return;
+    }
+    pos = end + 1;
+  }
+
+  // A single-hart log has no prefix; the rest do not matter if they never
+  // appear.
+  for (int i = 1; i < 8; i++)
+    set_width(fields[i], defaults[i]);
+}
+
+static void write_all(const char* p, size_t len)
+{
+  while (len) {
+    ssize_t n = write(STDOUT_FILENO, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      perror("commit_log_encode: write");
+      exit(1);
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1])) {
+    fprintf(stderr, "usage: %s [FILE] > LOG\n", argv[0]);
+    return 1;
+  }
+
+  int fd = STDIN_FILENO;
+  if (argc == 2 && strcmp(argv[1], "-") != 0) {
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "commit_log_encode: cannot open %s: %s\n", argv[1], strerror(errno));
+      return 1;
+    }
+  }
+
+  // The widths have to be known before the first record, so the log is
+  // mapped, or read whole if it is not a regular file.
+  const char* data = NULL;
+  size_t size = 0;
+  std::vector<char> contents;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      data = (const char*)map;
+      size = st.st_size;
+    }
+  }
+  if (!data) {
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0) {
+        perror("commit_log_encode: read");
+        return 1;
+      }
+      contents.insert(contents.end(), buf, buf + n);
+    }
+    data = contents.data();
+    size = contents.size();
+  }
+
+  commit_log_header_t h;
+  find_widths(data, size, &h);
+  commit_log_printer_t printer(h);
+  commit_log_encoder_t encoder;
+
+  std::vector<char> out;
+  out.insert(out.end(), (const char*)&h, (const char*)&h + sizeof(h));
+  std::string text;
+  uint64_t lines = 0, text_lines = 0;
+  for (size_t pos = 0; pos < size; ) {
+    const char* nl = (const char*)memchr(data + pos, '\n', size - pos);
+    size_t end = nl ? nl - data : size;
+    const char* line = data + pos;
+    size_t len = end - pos;
+
+    commit_log_record_t r;
+    widths_t w;
+    bool ok = parse_line(line, len, &r, &w);
+    if (ok) {
+      text.clear();
+      printer.print(r, text);
+      ok = text.size() == len && memcmp(text.data(), line, len) == 0;
+    }
+    if (!ok) {
+      // It stays with the hart it says it is from, as comlog keeps it.
+      cursor_t c = { line, line + len };
+      uint64_t hart = 0;
+      int width;
+      if (!c.eat("C") || !c.dec(&hart, &width) || !c.eat(":"))
+        hart = 0;
+      memset(&r, 0, sizeof(r));
+      r.kind = COMMIT_LOG_TEXT;
+      r.hart = hart;
+      r.text = line;
+      r.text_len = len;
+      text_lines++;
+    }
+    encoder.encode(r, out);
+    lines++;
+
+    if (out.size() >= (1 << 20)) {
+      write_all(out.data(), out.size());
+      out.clear();
+    }
+    pos = end + 1;
+  }
+  write_all(out.data(), out.size());
+
+  if (text_lines)
+    fprintf(stderr, "commit_log_encode: %llu of %llu lines kept as text\n",
+            (unsigned long long)text_lines, (unsigned long long)lines);
+  return 0;
+}
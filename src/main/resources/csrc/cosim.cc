@@ -0,0 +1,501 @@
+// See LICENSE.SiFive for license details.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fesvr/elfloader.h>
+#include <fesvr/memif.h>
+#include <riscv/mmu.h>
+#include <riscv/processor.h>
+#include <riscv/simif.h>
+#include <riscv/trap.h>
+
+#include "cosim.h"
+#include "float_fix.h"
+
+// The spikes around the one of riscv-tools.hash differ in what processor_t
+// is constructed with (the privilege modes and the vector parameters came
+// later) and in whether simif_t has get_symbol. emulator/Makefile looks in
+// the installed headers and says which with SPIKE_PROCESSOR_PRIV,
+// SPIKE_PROCESSOR_VARCH and SPIKE_SIMIF_GET_SYMBOL. All of them keep
+// minstret in state_t as a plain reg_t.
+#ifndef DEFAULT_VARCH
+#define DEFAULT_VARCH "vlen:128,elen:64,slen:128"
+#endif
+
+static const uint64_t page_size = 4096;
+
+// Traps spike may take between two instructions the model commits.
+static const int max_traps = 8;
+
+// Instructions of each hart to show before a divergence.
+static const size_t history_size = 16;
+
+static uint64_t mask(int bits)
+{
+  return bits >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+}
+
+// Does insn read a counter, or mip or sip, whose value spike cannot know?
+static bool reads_counter(uint32_t insn)
+{
+  if ((insn & 0x7f) != 0x73 || ((insn >> 12) & 3) == 0)
+    return false;
+  uint32_t csr = insn >> 20;
+  return (csr >= 0xb00 && csr < 0xb20) || (csr >= 0xb80 && csr < 0xba0) ||
+         (csr >= 0xc00 && csr < 0xc20) || (csr >= 0xc80 && csr < 0xca0) ||
+         csr == 0x344 || csr == 0x144;
+}
+
+// A value the model wrote to an FP register against spike's. Spike keeps a
+// single NaN-boxed, and an fld of a single held in a double comes back from
+// the model recoded (see float_fix).
+static bool fp_matches(uint64_t model, uint64_t spike)
+{
+  if (model == spike)
+    return true;
+  if ((spike >> 32) == 0xffffffff && (uint32_t)model == (uint32_t)spike &&
+      ((model >> 32) == 0 || (model >> 32) == 0xffffffff))
+    return true;
+  return NestedFloatPossible(model) && UnrecodeFloatFromDouble(model) == spike;
+}
+
+// A partial commit waiting for its write-back.
+struct pending_t
+{
+  uint64_t expected;    // spike's value of rd after the instruction
+  bool from_model;      // spike cannot know it; take the model's
+  uint8_t rd;
+  bool fp;
+  std::string line;
+};
+
+struct hart_t
+{
+  hart_t() : proc(NULL), checked(0) { memset(shadow, 0, sizeof(shadow)); }
+
+  processor_t* proc;            // NULL until the hart reaches the entry point
+  uint64_t shadow[32];          // the model's x registers until then
+  uint64_t checked;
+  std::map<uint32_t, std::deque<pending_t> > pending;   // by pdst, oldest first
+  std::deque<std::string> history;
+};
+
+class cosim_t : public simif_t, public chunked_memif_t
+{
+ public:
+  cosim_t(const char* isa, uint64_t ram_base, uint64_t ram_size)
+    : isa(isa), ram_base(ram_base), ram_size(ram_size), entry(0),
+      failed(false), header_set(false), mmio_access(false)
+  {}
+
+  virtual ~cosim_t()
+  {
+    for (auto& h : harts)
+      delete h.proc;
+    for (auto& p : pages)
+      delete[] p.second;
+  }
+
+  bool load(const char* elf)
+  {
+    if (access(elf, R_OK) != 0) {
+      fprintf(stderr, "cosim: cannot read %s\n", elf);
+      return false;
+    }
+    memif_t memif(this);
+    reg_t entry_point;
+    std::map<std::string, uint64_t> symbols = load_elf(elf, &memif, &entry_point);
+    entry = entry_point;
+
+    // The host talks to the program through these; spike sees what the
+    // model reads from them.
+    const char* host_symbols[] = { "tohost", "fromhost" };
+    for (const char* name : host_symbols) {
+      auto it = symbols.find(name);
+      if (it != symbols.end())
+        host_pages.push_back(it->second & ~(page_size - 1));
+    }
+    return true;
+  }
+
+  // simif_t
+  char* addr_to_mem(reg_t addr) override
+  {
+    uint64_t page = addr & ~(page_size - 1);
+    if (addr - ram_base >= ram_size || is_host_page(page))
+      return NULL;
+    return page_data(page) + (addr - page);
+  }
+
+  bool mmio_load(reg_t addr, size_t len, uint8_t* bytes) override
+  {
+    memset(bytes, 0, len);
+    mmio_access = true;
+    return true;
+  }
+
+  bool mmio_store(reg_t addr, size_t len, const uint8_t* bytes) override
+  {
+    mmio_access = true;
+    return true;
+  }
+
+  void proc_reset(unsigned id) override {}
+
+#ifdef SPIKE_SIMIF_GET_SYMBOL
+  const char* get_symbol(uint64_t addr) override { return NULL; }
+#endif
+
+  // chunked_memif_t, for load_elf and for what the host writes later
+  void read_chunk(addr_t taddr, size_t len, void* dst) override
+  {
+    copy(taddr, len, NULL, static_cast<uint8_t*>(dst));
+  }
+
+  void write_chunk(addr_t taddr, size_t len, const void* src) override
+  {
+    static const uint8_t zero = 0;
+    copy(taddr, len, src ? static_cast<const uint8_t*>(src) : &zero, NULL, src == NULL);
+    for (auto& h : harts) {
+      if (h.proc)
+        h.proc->get_mmu()->flush_icache();
+    }
+  }
+
+  void clear_chunk(addr_t taddr, size_t len) override
+  {
+    write_chunk(taddr, len, NULL);
+  }
+
+  size_t chunk_align() override { return 1; }
+  size_t chunk_max_size() override { return page_size; }
+
+  void commit(int widths, const commit_log_record_t& r)
+  {
+    if (failed)
+      return;
+    set_header(widths);
+    hart_t& h = hart(r.hart);
+    std::string line;
+    printer->print(r, line);
+    remember(h, line);
+
+    int pc_bits = (widths >> 8) & 0xff;
+    if (!h.proc) {
+      if ((r.pc & mask(pc_bits)) != (entry & mask(pc_bits))) {
+        if (r.has_rd && !r.fp && !r.partial)
+          h.shadow[r.rd] = r.data;
+        return;
+      }
+      start(h, r);
+    }
+
+    state_t* s = h.proc->get_state();
+    reg_t pc, prv;
+    mmio_access = false;
+    int traps = 0;
+    for (;;) {
+      pc = s->pc;
+      prv = s->prv;
+      reg_t instret = s->minstret;
+      h.proc->step(1);
+      if (s->minstret != instret)
+        break;
+      if (++traps > max_traps) {
+        char what[64];
+        snprintf(what, sizeof(what), "spike took %d traps in a row", traps);
+        fail(r.hart, what, line, describe(pc, prv, 0));
+        return;
+      }
+    }
+
+    if ((pc & mask(pc_bits)) != (r.pc & mask(pc_bits))) {
+      fail(r.hart, "PC differs", line, describe(pc, prv, 0));
+      return;
+    }
+    if (prv != r.priv) {
+      fail(r.hart, "privilege mode differs", line, describe(pc, prv, 0));
+      return;
+    }
+    uint32_t insn = 0;
+    try {
+      insn = h.proc->get_mmu()->load_insn(pc).insn.bits();
+    } catch (trap_t&) {
+    }
+    uint32_t insn_mask = (insn & 3) == 3 ? 0xffffffff : 0xffff;
+    if ((insn & insn_mask) != (r.insn & insn_mask)) {
+      fail(r.hart, "instruction differs", line, describe(pc, prv, insn));
+      return;
+    }
+    h.checked++;
+    if (!r.has_rd)
+      return;
+
+    uint64_t value = r.fp ? s->FPR[r.rd].v[0] : s->XPR[r.rd];
+    bool from_model = mmio_access || reads_counter(r.insn);
+    if (r.partial) {
+      pending_t p;
+      p.expected = value;
+      p.from_model = from_model;
+      p.rd = r.rd;
+      p.fp = r.fp;
+      p.line = line;
+      h.pending[r.pdst].push_back(p);
+      return;
+    }
+    check_value(h, r.hart, widths, r.fp, r.rd, r.data, value, from_model, line,
+                describe(pc, prv, insn));
+  }
+
+  void writeback(int widths, const commit_log_record_t& r)
+  {
+    if (failed)
+      return;
+    set_header(widths);
+    hart_t& h = hart(r.hart);
+    std::string line;
+    printer->print(r, line);
+    remember(h, line);
+
+    if (!h.proc) {
+      if (!r.fp)
+        h.shadow[r.rd] = r.data;
+      return;
+    }
+    std::deque<pending_t>& q = h.pending[r.pdst];
+    if (q.empty()) {
+      fail(r.hart, "write-back with no partial commit waiting for it", line, "");
+      return;
+    }
+    pending_t p = q.front();
+    q.pop_front();
+    check_value(h, r.hart, widths, p.fp, p.rd, r.data, p.expected, p.from_model,
+                p.line + " <- " + line, "");
+  }
+
+  bool has_failed() const { return failed; }
+
+  // Say how many instructions were checked, always if none were.
+  void report(bool verbose)
+  {
+    uint64_t checked = 0;
+    int started = 0;
+    for (auto& h : harts) {
+      checked += h.checked;
+      started += h.proc != NULL;
+    }
+    if (verbose || !checked)
+      fprintf(stderr, "cosim: %llu instructions checked against spike on %d harts\n",
+              (unsigned long long)checked, started);
+    if (harts.empty())
+      fprintf(stderr, "cosim: no commit log came from the model; was it built with enableCommitLog?\n");
+  }
+
+ private:
+  bool is_host_page(uint64_t page) const
+  {
+    for (uint64_t p : host_pages) {
+      if (p == page)
+        return true;
+    }
+    return false;
+  }
+
+  char* page_data(uint64_t page)
+  {
+    char*& data = pages[page];
+    if (!data) {
+      data = new char[page_size];
+      memset(data, 0, page_size);
+    }
+    return data;
+  }
+
+  // Copy len bytes of RAM at addr from src (the same byte if repeat) or to
+  // dst; what is not RAM reads as zeros and ignores writes.
+  void copy(uint64_t addr, size_t len, const uint8_t* src, uint8_t* dst, bool repeat = false)
+  {
+    while (len) {
+      uint64_t page = addr & ~(page_size - 1);
+      size_t offset = addr - page;
+      size_t n = std::min<uint64_t>(len, page_size - offset);
+      bool ram = page - ram_base < ram_size;
+      if (dst) {
+        if (ram)
+          memcpy(dst, page_data(page) + offset, n);
+        else
+          memset(dst, 0, n);
+        dst += n;
+      } else {
+        if (ram && repeat)
+          memset(page_data(page) + offset, *src, n);
+        else if (ram)
+          memcpy(page_data(page) + offset, src, n);
+        if (!repeat)
+          src += n;
+      }
+      addr += n;
+      len -= n;
+    }
+  }
+
+  void set_header(int widths)
+  {
+    if (header_set)
+      return;
+    commit_log_header_t header;
+    commit_log_header_init(&header, widths & 0xff, (widths >> 8) & 0xff,
+                           (widths >> 16) & 0xff, (widths >> 24) & 0xff);
+    printer.reset(new commit_log_printer_t(header));
+    header_set = true;
+  }
+
+  hart_t& hart(uint32_t id)
+  {
+    if (id >= harts.size())
+      harts.resize(id + 1);
+    return harts[id];
+  }
+
+  void start(hart_t& h, const commit_log_record_t& r)
+  {
+#if defined(SPIKE_PROCESSOR_PRIV)
+    h.proc = new processor_t(isa.c_str(), "MSU", DEFAULT_VARCH, this, r.hart, false);
+#elif defined(SPIKE_PROCESSOR_VARCH)
+    h.proc = new processor_t(isa.c_str(), DEFAULT_VARCH, this, r.hart, false);
+#else
+    h.proc = new processor_t(isa.c_str(), this, r.hart, false);
+#endif
+    state_t* s = h.proc->get_state();
+    for (int i = 1; i < 32; i++)
+      s->XPR.write(i, h.shadow[i]);
+    h.proc->set_privilege(r.priv);
+    s->pc = entry;
+  }
+
+  void remember(hart_t& h, const std::string& line)
+  {
+    h.history.push_back(line);
+    if (h.history.size() > history_size)
+      h.history.pop_front();
+  }
+
+  std::string describe(reg_t pc, reg_t prv, uint32_t insn)
+  {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "priv %d pc 0x%016llx insn 0x%08x", (int)prv,
+             (unsigned long long)pc, insn);
+    return buf;
+  }
+
+  void check_value(hart_t& h, uint32_t hart, int widths, bool fp, int rd,
+                   uint64_t model, uint64_t expected, bool from_model,
+                   const std::string& line, const std::string& spike)
+  {
+    state_t* s = h.proc->get_state();
+    if (from_model) {
+      if (fp) {
+        freg_t f;
+        f.v[0] = model;
+        f.v[1] = ~UINT64_C(0);
+        s->FPR.write(rd, f);
+      } else {
+        s->XPR.write(rd, model);
+      }
+      return;
+    }
+
+    int xlen = (widths >> 16) & 0xff;
+    bool ok = fp ? fp_matches(model, expected)
+                 : (model & mask(xlen)) == (expected & mask(xlen));
+    if (!ok) {
+      char value[160];
+      snprintf(value, sizeof(value), "%s%s%c%d 0x%016llx", spike.c_str(),
+               spike.empty() ? "" : "; ", fp ? 'f' : 'x', rd, (unsigned long long)expected);
+      fail(hart, "value written differs", line, value);
+    }
+  }
+
+  void fail(uint32_t hart, const char* what, const std::string& model, const std::string& spike)
+  {
+    hart_t& h = harts[hart];
+    fprintf(stderr, "cosim: hart %u diverges from spike after %llu instructions: %s\n",
+            hart, (unsigned long long)h.checked, what);
+    fprintf(stderr, "  rocket: %s\n", model.c_str());
+    if (!spike.empty())
+      fprintf(stderr, "  spike:  %s\n", spike.c_str());
+    fprintf(stderr, "  the commit log of hart %u up to there:\n", hart);
+    for (auto& l : h.history)
+      fprintf(stderr, "    %s\n", l.c_str());
+    failed = true;
+  }
+
+  std::string isa;
+  uint64_t ram_base;
+  uint64_t ram_size;
+  uint64_t entry;
+  bool failed;
+  bool header_set;
+  bool mmio_access;     // by the instruction spike is stepping
+  std::unique_ptr<commit_log_printer_t> printer;
+  std::vector<uint64_t> host_pages;
+  std::map<uint64_t, char*> pages;
+  std::vector<hart_t> harts;
+};
+
+static cosim_t* cosim = NULL;
+
+bool cosim_open(const char* elf, const char* isa, uint64_t ram_base, uint64_t ram_size)
+{
+  cosim = new cosim_t(isa, ram_base, ram_size);
+  if (!cosim->load(elf)) {
+    delete cosim;
+    cosim = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool cosim_enabled()
+{
+  return cosim != NULL;
+}
+
+void cosim_write(uint64_t addr, size_t len, const void* src)
+{
+  if (cosim)
+    cosim->write_chunk(addr, len, src);
+}
+
+void cosim_commit(int widths, const commit_log_record_t& r)
+{
+  cosim->commit(widths, r);
+}
+
+void cosim_writeback(int widths, const commit_log_record_t& r)
+{
+  cosim->writeback(widths, r);
+}
+
+bool cosim_failed()
+{
+  return cosim && cosim->has_failed();
+}
+
+void cosim_close(bool verbose)
+{
+  if (!cosim)
+    return;
+  cosim->report(verbose);
+  delete cosim;
+  cosim = NULL;
+}
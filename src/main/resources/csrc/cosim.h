@@ -0,0 +1,53 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef COSIM_H
+#define COSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "commit_log.h"
+
+// Lockstep co-simulation against spike (--cosim), for emulators built with
+// COSIM=1 from a config with WithCommitLog (enableCommitLog), such as
+// CosimConfig; `make cosim-check` checks one against the installed spike.
+//
+// Every instruction a hart commits, as SimCommitLog reports it, steps a
+// spike processor_t of the same hart by one instruction, and the PC, the
+// privilege mode, the instruction and the value written to rd are compared.
+// The value of a partial commit is compared when its write-back arrives,
+// matched by pdst as comlog does. Values that spike cannot know, loads from
+// outside RAM (tohost and fromhost included) and reads of the counters, are
+// copied from the model into spike instead of compared.
+//
+// Spike starts on a hart at the first instruction the hart commits at the
+// program's entry point, with the integer registers the hart had then;
+// what it ran before (the boot ROM, the debug module) is not checked.
+// Interrupts are not mirrored into spike, so a program that takes one
+// diverges there.
+
+// Load the program at elf into spike's memory, which is RAM in
+// [ram_base, ram_base + ram_size), and check from now on against a spike
+// of the given ISA. Returns false, having said why, if the program cannot
+// be loaded.
+bool cosim_open(const char* elf, const char* isa, uint64_t ram_base, uint64_t ram_size);
+
+bool cosim_enabled();
+
+// The host wrote len bytes at addr of the target's memory; src NULL for
+// zeros.
+void cosim_write(uint64_t addr, size_t len, const void* src);
+
+// Records as SimCommitLog gets them, with the widths of the model's signals
+// packed as it gets them.
+void cosim_commit(int widths, const commit_log_record_t& r);
+void cosim_writeback(int widths, const commit_log_record_t& r);
+
+// True once a hart has diverged from spike, which has been reported.
+bool cosim_failed();
+
+// Say how many instructions were checked, if verbose or if none were, and
+// free spike.
+void cosim_close(bool verbose);
+
+#endif
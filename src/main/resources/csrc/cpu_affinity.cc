@@ -0,0 +1,118 @@
+// See LICENSE.SiFive for license details.
+
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include "cpu_affinity.h"
+
+bool cpu_list_parse(const char* list, std::vector<int>& cpus)
+{
+  const char* p = list;
+  while (*p) {
+    char* end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0)
+      return false;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first)
+        return false;
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+    if (*p == ',')
+      p++;
+    else if (*p && *p != '\n')
+      return false;
+    else
+      break;
+  }
+  return !cpus.empty();
+}
+
+static bool read_cpu_list(const std::string& path, std::vector<int>& cpus)
+{
+  std::ifstream in(path);
+  std::string line;
+  return getline(in, line) && cpu_list_parse(line.c_str(), cpus);
+}
+
+bool cpu_list_numa_node(int node, std::vector<int>& cpus)
+{
+  std::vector<int> node_cpus;
+  if (!read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist",
+                     node_cpus))
+    return false;
+
+  // The lowest-numbered CPU of each core goes first.
+  std::vector<int> siblings;
+  for (int cpu : node_cpus) {
+    std::vector<int> core;
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                       "/topology/thread_siblings_list";
+    if (read_cpu_list(path, core) && *std::min_element(core.begin(), core.end()) != cpu)
+      siblings.push_back(cpu);
+    else
+      cpus.push_back(cpu);
+  }
+  cpus.insert(cpus.end(), siblings.begin(), siblings.end());
+  return true;
+}
+
+bool numa_prefer_node(int node)
+{
+#ifdef SYS_set_mempolicy
+  const int mpol_preferred = 1; // MPOL_PREFERRED, from <numaif.h>
+  unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {0};
+  if (node < 0 || node >= (int)(8 * sizeof(mask)))
+    return false;
+  mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+  return syscall(SYS_set_mempolicy, mpol_preferred, mask, 8 * sizeof(mask)) == 0;
+#else
+  return false;
+#endif
+}
+
+std::vector<pid_t> thread_list()
+{
+  std::vector<pid_t> threads;
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir)
+    return threads;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.')
+      threads.push_back(atoi(entry->d_name));
+  }
+  closedir(dir);
+  std::sort(threads.begin(), threads.end());
+  return threads;
+}
+
+bool thread_pin(const std::vector<pid_t>& threads, const std::vector<int>& cpus)
+{
+  bool ok = true;
+  for (size_t i = 0; i < threads.size() && i < cpus.size(); i++) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[i], &set);
+    if (sched_setaffinity(threads[i], sizeof(set), &set) != 0) {
+      fprintf(stderr, "Unable to pin thread %d to CPU %d: %s\n",
+              (int)threads[i], cpus[i], strerror(errno));
+      ok = false;
+    }
+  }
+  return ok;
+}
@@ -0,0 +1,25 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <sys/types.h>
+#include <vector>
+
+// Parse a CPU list such as "0-3,8,10-11" into cpus, in the order given.
+bool cpu_list_parse(const char* list, std::vector<int>& cpus);
+
+// The CPUs of a NUMA node, one per physical core first and then their SMT
+// siblings, so that taking the first N gives N threads their own cores.
+bool cpu_list_numa_node(int node, std::vector<int>& cpus);
+
+// Prefer allocating memory on a NUMA node from now on.
+bool numa_prefer_node(int node);
+
+// The IDs of the threads of this process.
+std::vector<pid_t> thread_list();
+
+// Pin threads[i] to cpus[i]; the lists must be the same length.
+bool thread_pin(const std::vector<pid_t>& threads, const std::vector<int>& cpus);
+
+#endif
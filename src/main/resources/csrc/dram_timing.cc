@@ -0,0 +1,327 @@
+// See LICENSE.SiFive for license details.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "dram_timing.h"
+
+static const unsigned histogram_buckets = 64;
+
+// DDR4-2400 (17-17-17), one 64-bit channel of 8Gb x8 parts, with the chip
+// at 1 GHz.
+static const dram_timing_params_t default_params = {
+  16,           // banks
+  8192,         // row_bytes
+  8192,         // interleave_bytes
+  true,         // open_page
+  10,           // controller_latency
+  14,           // tCAS
+  14,           // tRCD
+  14,           // tRP
+  32,           // tRAS
+  15,           // tWR
+  7800,         // tREFI
+  350,          // tRFC
+  19.2,         // bytes_per_cycle
+  10,           // histogram_bucket
+};
+
+static bool is_pow2(uint64_t x)
+{
+  return x && !(x & (x - 1));
+}
+
+bool dram_timing_load(const char* filename, dram_timing_params_t* params)
+{
+  *params = default_params;
+  FILE* f = fopen(filename, "r");
+  if (!f) {
+    fprintf(stderr, "Unable to open %s for the DRAM timing\n", filename);
+    return false;
+  }
+
+  struct { const char* name; unsigned* value; } uints[] = {
+    {"banks", &params->banks},
+    {"controller_latency", &params->controller_latency},
+    {"tCAS", &params->tCAS},
+    {"tRCD", &params->tRCD},
+    {"tRP", &params->tRP},
+    {"tRAS", &params->tRAS},
+    {"tWR", &params->tWR},
+    {"tREFI", &params->tREFI},
+    {"tRFC", &params->tRFC},
+    {"histogram_bucket", &params->histogram_bucket},
+  };
+
+  char buf[256];
+  int line = 0;
+  bool ok = true;
+  while (ok && fgets(buf, sizeof(buf), f)) {
+    line++;
+    std::string s(buf);
+    s = s.substr(0, s.find('#'));
+    size_t eq = s.find('=');
+    std::string name = s.substr(0, eq);
+    name.erase(0, name.find_first_not_of(" \t\r\n"));
+    name.erase(name.find_last_not_of(" \t\r\n") + 1);
+    if (name.empty() && eq == std::string::npos)
+      continue;
+    std::string value = eq == std::string::npos ? "" : s.substr(eq + 1);
+    value.erase(0, value.find_first_not_of(" \t\r\n"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+
+    const char* v = value.c_str();
+    char* end = NULL;
+    bool known = true;
+    if (name == "page_policy") {
+      if (value == "open")
+        params->open_page = true;
+      else if (value == "closed")
+        params->open_page = false;
+      else
+        end = const_cast<char*>(v);
+    } else if (name == "row_bytes") {
+      params->row_bytes = strtoull(v, &end, 0);
+    } else if (name == "interleave_bytes") {
+      params->interleave_bytes = strtoull(v, &end, 0);
+    } else if (name == "bytes_per_cycle") {
+      params->bytes_per_cycle = strtod(v, &end);
+    } else {
+      known = false;
+      for (auto& u : uints) {
+        if (name == u.name) {
+          *u.value = strtoul(v, &end, 0);
+          known = true;
+        }
+      }
+    }
+
+    if (!known) {
+      fprintf(stderr, "%s:%d: unknown DRAM parameter \"%s\"\n", filename, line, name.c_str());
+      ok = false;
+    } else if (value.empty() || (end && *end)) {
+      fprintf(stderr, "%s:%d: bad value for %s\n", filename, line, name.c_str());
+      ok = false;
+    }
+  }
+  fclose(f);
+  if (!ok)
+    return false;
+
+  if (!params->banks || !is_pow2(params->row_bytes) || !is_pow2(params->interleave_bytes) ||
+      params->interleave_bytes > params->row_bytes || !(params->bytes_per_cycle > 0) ||
+      !params->tREFI || params->tRFC >= params->tREFI || !params->histogram_bucket) {
+    fprintf(stderr, "%s: banks, tREFI, histogram_bucket and bytes_per_cycle must be above 0, "
+            "tRFC below tREFI, and row_bytes and interleave_bytes powers of 2 with "
+            "interleave_bytes no more than row_bytes\n", filename);
+    return false;
+  }
+  return true;
+}
+
+dram_timing_t::dram_timing_t(const dram_timing_params_t& params)
+  : params(params), banks(params.banks), issue(0), bus_free(0), next_refresh(params.tREFI),
+    row_hits(0), row_misses(0), row_conflicts(0), refreshes(0), bus_busy(0)
+{
+  for (auto& b : banks) {
+    b.open_row = -1;
+    b.activated = b.ready = b.precharge = 0;
+  }
+  for (int i = 0; i < 2; i++) {
+    bytes[i] = 0;
+    latency[i].count = latency[i].total = latency[i].max = 0;
+    latency[i].histogram.assign(histogram_buckets, 0);
+  }
+}
+
+// Do the refreshes due by cycle t. Each waits for every bank to be done and
+// precharged, and closes them all.
+void dram_timing_t::refresh(uint64_t t)
+{
+  if (t < next_refresh)
+    return;
+
+  // All but the last of a long idle spell's refreshes are over by t.
+  uint64_t skipped = (t - next_refresh) / params.tREFI;
+  refreshes += skipped;
+  next_refresh += skipped * params.tREFI;
+
+  while (t >= next_refresh) {
+    uint64_t start = next_refresh;
+    for (auto& b : banks) {
+      uint64_t idle = b.open_row < 0 ? b.ready :
+        std::max(std::max(b.ready, b.precharge), b.activated + params.tRAS) + params.tRP;
+      start = std::max(start, idle);
+    }
+    for (auto& b : banks) {
+      b.open_row = -1;
+      b.ready = start + params.tRFC;
+    }
+    refreshes++;
+    next_refresh += params.tREFI;
+  }
+}
+
+void dram_timing_t::access(uint64_t now, uint64_t addr, uint64_t len, bool write,
+                           uint64_t* start, uint64_t* end)
+{
+  uint64_t chunk = addr / params.interleave_bytes;
+  bank_t& b = banks[chunk % params.banks];
+  int64_t row = chunk / params.banks / (params.row_bytes / params.interleave_bytes);
+
+  uint64_t t = std::max(now + params.controller_latency, issue);
+  refresh(t);
+  t = std::max(t, b.ready);
+  issue = t + 1;
+
+  if (b.open_row == row) {
+    row_hits++;
+  } else {
+    if (b.open_row >= 0) {
+      row_conflicts++;
+      t = std::max(std::max(t, b.precharge), b.activated + params.tRAS) + params.tRP;
+    } else {
+      row_misses++;
+    }
+    b.open_row = row;
+    b.activated = t;
+    t += params.tRCD;
+  }
+
+  uint64_t cycles = std::max<uint64_t>(1, (uint64_t)ceil(len / params.bytes_per_cycle));
+  *start = std::max(t + params.tCAS, bus_free);
+  *end = *start + cycles;
+  bus_free = *end;
+  bus_busy += cycles;
+  bytes[write] += len;
+
+  // The next column access to the bank can follow this one's data.
+  b.ready = t + cycles;
+  if (write)
+    b.precharge = *end + params.tWR;
+  if (!params.open_page) {
+    b.ready = std::max(std::max(*end, b.precharge), b.activated + params.tRAS) + params.tRP;
+    b.open_row = -1;
+  }
+}
+
+void dram_timing_t::record_latency(bool write, uint64_t cycles)
+{
+  latency_t& l = latency[write];
+  l.count++;
+  l.total += cycles;
+  l.max = std::max(l.max, cycles);
+  l.histogram[std::min<uint64_t>(cycles / params.histogram_bucket, histogram_buckets - 1)]++;
+}
+
+void dram_timing_t::print_stats(FILE* f, const char* name, uint64_t cycles) const
+{
+  uint64_t accesses = row_hits + row_misses + row_conflicts;
+  fprintf(f, "SimDRAM %s: %llu reads (mean %.1f, max %llu cycles), "
+          "%llu writes (mean %.1f, max %llu cycles)\n", name,
+          (unsigned long long)latency[0].count,
+          latency[0].count ? (double)latency[0].total / latency[0].count : 0.0,
+          (unsigned long long)latency[0].max,
+          (unsigned long long)latency[1].count,
+          latency[1].count ? (double)latency[1].total / latency[1].count : 0.0,
+          (unsigned long long)latency[1].max);
+  fprintf(f, "SimDRAM %s: rows %.1f%% hit, %.1f%% miss, %.1f%% conflict; "
+          "%llu refreshes; bus %.1f%% busy, %.3f bytes/cycle\n", name,
+          accesses ? 100.0 * row_hits / accesses : 0.0,
+          accesses ? 100.0 * row_misses / accesses : 0.0,
+          accesses ? 100.0 * row_conflicts / accesses : 0.0,
+          (unsigned long long)refreshes,
+          cycles ? 100.0 * std::min(bus_busy, cycles) / cycles : 0.0,
+          cycles ? (double)(bytes[0] + bytes[1]) / cycles : 0.0);
+}
+
+void dram_timing_t::write_latency_json(FILE* f, const char* name, const latency_t& l,
+                                       unsigned bucket)
+{
+  fprintf(f, "      \"%s\": {\"count\": %llu, \"mean\": %.3f, \"max\": %llu, "
+          "\"bucket_cycles\": %u, \"histogram\": [", name,
+          (unsigned long long)l.count, l.count ? (double)l.total / l.count : 0.0,
+          (unsigned long long)l.max, bucket);
+  // Up to the last bucket that has anything in it.
+  size_t n = l.histogram.size();
+  while (n && !l.histogram[n - 1])
+    n--;
+  for (size_t i = 0; i < n; i++)
+    fprintf(f, "%s%llu", i ? ", " : "", (unsigned long long)l.histogram[i]);
+  fprintf(f, "]}");
+}
+
+void dram_timing_t::write_json(FILE* f, const char* name, uint64_t cycles) const
+{
+  fprintf(f, "    {\n");
+  fprintf(f, "      \"name\": \"%s\",\n", name);
+  fprintf(f, "      \"cycles\": %llu,\n", (unsigned long long)cycles);
+  fprintf(f, "      \"bytes_read\": %llu,\n", (unsigned long long)bytes[0]);
+  fprintf(f, "      \"bytes_written\": %llu,\n", (unsigned long long)bytes[1]);
+  fprintf(f, "      \"bytes_per_cycle\": %.6f,\n",
+          cycles ? (double)(bytes[0] + bytes[1]) / cycles : 0.0);
+  fprintf(f, "      \"bus_utilization\": %.6f,\n",
+          cycles ? (double)std::min(bus_busy, cycles) / cycles : 0.0);
+  fprintf(f, "      \"row_hits\": %llu,\n", (unsigned long long)row_hits);
+  fprintf(f, "      \"row_misses\": %llu,\n", (unsigned long long)row_misses);
+  fprintf(f, "      \"row_conflicts\": %llu,\n", (unsigned long long)row_conflicts);
+  fprintf(f, "      \"refreshes\": %llu,\n", (unsigned long long)refreshes);
+  write_latency_json(f, "read_latency", latency[0], params.histogram_bucket);
+  fprintf(f, ",\n");
+  write_latency_json(f, "write_latency", latency[1], params.histogram_bucket);
+  fprintf(f, "\n    }");
+}
+
+void dram_timing_t::save(sim_dram_io_t write, void* ctx) const
+{
+  dram_timing_params_t p = params;
+  write(ctx, &p, sizeof(p));
+  for (auto& b : banks) {
+    bank_t copy = b;
+    write(ctx, &copy, sizeof(copy));
+  }
+  uint64_t state[] = {issue, bus_free, next_refresh, bytes[0], bytes[1], row_hits,
+                      row_misses, row_conflicts, refreshes, bus_busy};
+  write(ctx, state, sizeof(state));
+  for (int i = 0; i < 2; i++) {
+    uint64_t l[] = {latency[i].count, latency[i].total, latency[i].max};
+    write(ctx, l, sizeof(l));
+    std::vector<uint64_t> h = latency[i].histogram;
+    write(ctx, h.data(), h.size() * sizeof(h[0]));
+  }
+}
+
+dram_timing_t* dram_timing_t::restore(sim_dram_io_t read, void* ctx)
+{
+  dram_timing_params_t p;
+  read(ctx, &p, sizeof(p));
+  dram_timing_t* t = new dram_timing_t(p);
+  for (auto& b : t->banks)
+    read(ctx, &b, sizeof(b));
+  uint64_t state[10];
+  read(ctx, state, sizeof(state));
+  t->issue = state[0];
+  t->bus_free = state[1];
+  t->next_refresh = state[2];
+  t->bytes[0] = state[3];
+  t->bytes[1] = state[4];
+  t->row_hits = state[5];
+  t->row_misses = state[6];
+  t->row_conflicts = state[7];
+  t->refreshes = state[8];
+  t->bus_busy = state[9];
+  for (int i = 0; i < 2; i++) {
+    uint64_t l[3];
+    read(ctx, l, sizeof(l));
+    t->latency[i].count = l[0];
+    t->latency[i].total = l[1];
+    t->latency[i].max = l[2];
+    read(ctx, t->latency[i].histogram.data(),
+         t->latency[i].histogram.size() * sizeof(uint64_t));
+  }
+  return t;
+}
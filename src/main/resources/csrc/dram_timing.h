@@ -0,0 +1,111 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef DRAM_TIMING_H
+#define DRAM_TIMING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "SimDRAM.h"
+
+// A DRAM timing model for SimDRAM (--dram-config), so that a program's
+// cycle count on the emulator reflects what its memory traffic would cost.
+//
+// Each SimDRAM is a channel: banks, each with at most one row open, behind
+// a data bus of limited bandwidth. The controller takes bursts in the order
+// they arrive, reads and writes alike, controller_latency cycles after
+// they do. A burst to the row open in its bank goes straight to the column
+// access (a row hit); to an idle bank, the row is activated first, tRCD
+// before it (a row miss); and to a bank with another row open, that row is
+// precharged, tRP before the activate and no sooner than tRAS after it was
+// activated or tWR after it was last written (a row conflict). Its data
+// takes the bus tCAS after the column access, once the bus is free, for as
+// long as bytes_per_cycle allows. Every tREFI cycles all banks are closed
+// and refreshed, which keeps them busy for tRFC cycles. With a closed page
+// policy every access precharges its row as soon as it can.
+//
+// Times are in cycles of the clock of the test harness, so a part's timing
+// in ns has to be scaled by the clock the emulated chip is meant to run at.
+
+struct dram_timing_params_t
+{
+  unsigned banks;
+  uint64_t row_bytes;           // of a row of one bank
+  uint64_t interleave_bytes;    // mapped to one bank before the next
+  bool open_page;
+  unsigned controller_latency;
+  unsigned tCAS;
+  unsigned tRCD;
+  unsigned tRP;
+  unsigned tRAS;
+  unsigned tWR;
+  unsigned tREFI;
+  unsigned tRFC;
+  double bytes_per_cycle;
+  unsigned histogram_bucket;    // width of a latency histogram bucket
+};
+
+// Set params to the defaults, then to what the lines "name = value" of
+// filename give ('#' starts a comment). Returns false, having said why, if
+// the file cannot be read or is wrong.
+bool dram_timing_load(const char* filename, dram_timing_params_t* params);
+
+class dram_timing_t
+{
+ public:
+  explicit dram_timing_t(const dram_timing_params_t& params);
+
+  // A burst of len bytes at addr, given to the controller at cycle now, has
+  // its data on the bus from *start to *end.
+  void access(uint64_t now, uint64_t addr, uint64_t len, bool write,
+              uint64_t* start, uint64_t* end);
+
+  // The master saw a burst answered cycles after it sent its address.
+  void record_latency(bool write, uint64_t cycles);
+
+  // Statistics over cycles cycles: a line for stderr, and a JSON object.
+  void print_stats(FILE* f, const char* name, uint64_t cycles) const;
+  void write_json(FILE* f, const char* name, uint64_t cycles) const;
+
+  void save(sim_dram_io_t write, void* ctx) const;
+  static dram_timing_t* restore(sim_dram_io_t read, void* ctx);
+
+ private:
+  struct bank_t
+  {
+    int64_t open_row;           // -1 if none
+    uint64_t activated;
+    uint64_t ready;             // for the next command
+    uint64_t precharge;         // earliest precharge, after write recovery
+  };
+
+  struct latency_t
+  {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    std::vector<uint64_t> histogram;    // the last bucket is open-ended
+  };
+
+  void refresh(uint64_t t);
+  static void write_latency_json(FILE* f, const char* name, const latency_t& l,
+                                 unsigned bucket);
+
+  dram_timing_params_t params;
+  std::vector<bank_t> banks;
+  uint64_t issue;               // earliest cycle the next burst can start
+  uint64_t bus_free;
+  uint64_t next_refresh;
+
+  uint64_t bytes[2];            // read, written
+  uint64_t row_hits;
+  uint64_t row_misses;
+  uint64_t row_conflicts;
+  uint64_t refreshes;
+  uint64_t bus_busy;
+  latency_t latency[2];
+};
+
+#endif
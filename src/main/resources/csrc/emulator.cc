@@ -9,9 +9,30 @@
 #include "verilated_fst_c.h"
 #endif
 #endif
+#if VM_SAVABLE
+#include "verilated_save.h"
+#endif
 #include <fesvr/dtm.h>
+#include "SimDTM.h"
+#include "SimCommitLog.h"
+#include "printf_filter.h"
+#ifdef COSIM
+#include "cosim.h"
+#endif
 #include "remote_bitbang.h"
+#include "mem_backdoor.h"
+#include "SimDRAM.h"
+#include "SimPerfMonitor.h"
+#include "pc_profile.h"
+#include "fork_server.h"
+#include "sim_stats.h"
+#include "flight_recorder.h"
+#include "trace_writer.h"
+#include "cpu_affinity.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <vector>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
@@ -34,7 +55,6 @@
 //   variables:
 //     - static const char * verilog_plusargs
 
-extern dtm_t* dtm;
 extern remote_bitbang_t * jtag;
 
 static uint64_t trace_count = 0;
@@ -47,9 +67,144 @@ bool done_reset;
   VerilatedVcdC *tfp = NULL;
 #endif
 
+// sim_dtm_t that notes when the target has been released to run, and that
+// can put the program into the harness memory through mem_backdoor instead
+// of writing it over DMI (--fast-load). Only the program load is redirected;
+// HTIF traffic after that goes through the debug module as usual.
+class emulator_dtm_t : public sim_dtm_t
+{
+ public:
+  emulator_dtm_t(int argc, char** argv, bool fast_load)
+    : sim_dtm_t(argc, argv), fast_load(fast_load), loading(false),
+      preloading(false), started(false) {}
+
+  bool target_started() { return started; }
+
+  // Load the program, as fesvr would, into the image of mem_backdoor, for
+  // the harness memories to take when the model is first evaluated. This
+  // has to happen before then; until fesvr runs, nothing of the target can
+  // be read, so the writes must not need to read back.
+  bool preload()
+  {
+    preloading = true;
+    bool ok = true;
+    try {
+      htif_t::load_program();
+    } catch (std::exception& e) {
+      std::cerr << "--fast-load: " << e.what() << "\n";
+      ok = false;
+    }
+    preloading = false;
+    return ok;
+  }
+
+ protected:
+  // With --fast-load the program is already in memory (preload()); fesvr
+  // still loads it, for the symbols it needs, but nothing goes to the
+  // target.
+  void load_program() override
+  {
+    loading = fast_load;
+    sim_dtm_t::load_program();
+    loading = false;
+  }
+
+  void write_chunk(addr_t taddr, size_t len, const void* src) override
+  {
+    if (preloading) {
+      mem_backdoor_write(taddr, len, src);
+      return;
+    }
+#ifdef COSIM
+    cosim_write(taddr, len, src);
+#endif
+    if (!loading)
+      sim_dtm_t::write_chunk(taddr, len, src);
+  }
+
+  void clear_chunk(addr_t taddr, size_t len) override
+  {
+    if (preloading) {
+      mem_backdoor_write(taddr, len, NULL);
+      return;
+    }
+#ifdef COSIM
+    cosim_write(taddr, len, NULL);
+#endif
+    if (!loading)
+      sim_dtm_t::clear_chunk(taddr, len);
+  }
+
+  // dtm_t's chunk sizes depend on the XLEN it asks the target for.
+  size_t chunk_align() override
+  {
+    return preloading ? 1 : sim_dtm_t::chunk_align();
+  }
+
+  size_t chunk_max_size() override
+  {
+    return preloading ? 4096 : sim_dtm_t::chunk_max_size();
+  }
+
+  // fesvr points the harts at the entry point and resumes them here.
+  void reset() override
+  {
+    dtm_t::reset();
+    started = true;
+  }
+
+ private:
+  bool fast_load;
+  bool loading;
+  bool preloading;
+  bool started;
+};
+
+// Has spike seen the model diverge (--cosim)?
+static bool cosim_stopped()
+{
+#ifdef COSIM
+  return cosim_failed();
+#else
+  return false;
+#endif
+}
+
 void handle_sigterm(int sig)
 {
-  dtm->stop();
+  if (dtm)
+    dtm->stop();
+}
+
+#if VM_TRACE
+static flight_recorder_t* recorder = NULL;
+static volatile sig_atomic_t recorder_dump_requested = 0;
+
+static void handle_sigusr1(int sig)
+{
+  recorder_dump_requested = 1;
+}
+#endif
+
+// Failed Chisel assertions and $fatal end the run through abort(), which
+// skips the normal end-of-run dump and leaves buffered printfs unwritten.
+static void handle_sigabrt(int sig)
+{
+#if VM_TRACE
+  if (recorder) {
+    flight_recorder_t* r = recorder;
+    recorder = NULL;
+    r->dump(trace_count, "abort");
+    delete r;
+  }
+#endif
+  fflush(stderr);
+}
+
+static void eval_model(TEST_HARNESS* tile)
+{
+  sim_stats_timer_t timer(sim_stats_eval_ns);
+  tile->eval();
 }
 
 double sc_time_stamp()
@@ -62,6 +217,166 @@ extern "C" int vpi_get_vlog_info(void* arg)
   return 0;
 }
 
+#if VM_SAVABLE
+// A checkpoint holds, in order: a magic number, trace_count, whether the run
+// used --fast-load, its DMI queue depth and idle skip, the HOST and TARGET arguments of the
+// run, the remote_bitbang_t pin state, the logged debug_tick inputs (see
+// SimDTM.h), the SimDRAM store (empty if the model has none), and finally
+// the Verilated model itself.
+static const char checkpoint_magic[8] = {'R', 'C', 'K', 'P', 'T', '0', '0', '6'};
+
+static void checkpoint_write(void* os, void* buf, size_t len)
+{
+  static_cast<VerilatedSave*>(os)->write(buf, len);
+}
+
+static void checkpoint_read(void* is, void* buf, size_t len)
+{
+  static_cast<VerilatedRestore*>(is)->read(buf, len);
+}
+
+static void save_checkpoint(const char* filename, TEST_HARNESS* tile,
+                            bool fast_load, int htif_argc, char** htif_argv)
+{
+  VerilatedSave os;
+  os.open(filename);
+  if (!os.isOpen()) {
+    std::cerr << "Unable to open " << filename << " for checkpoint write\n";
+    exit(1);
+  }
+
+  os.write(checkpoint_magic, sizeof(checkpoint_magic));
+  os.write(&trace_count, sizeof(trace_count));
+  os.write(&fast_load, sizeof(fast_load));
+  uint32_t depth = dtm_queue_depth();
+  os.write(&depth, sizeof(depth));
+  uint32_t idle_skip = dtm_idle_skip();
+  os.write(&idle_skip, sizeof(idle_skip));
+
+  uint32_t nargs = htif_argc - 1;
+  os.write(&nargs, sizeof(nargs));
+  for (int i = 1; i < htif_argc; i++) {
+    uint32_t len = strlen(htif_argv[i]);
+    os.write(&len, sizeof(len));
+    os.write(htif_argv[i], len);
+  }
+
+  remote_bitbang_t::snapshot_t jtag_state = jtag->snapshot();
+  os.write(&jtag_state, sizeof(jtag_state));
+
+  const std::vector<dtm_tick_run_t>& log = dtm_tick_log();
+  uint64_t nruns = log.size();
+  os.write(&nruns, sizeof(nruns));
+  if (nruns)
+    os.write(log.data(), nruns * sizeof(dtm_tick_run_t));
+
+  sim_dram_save(checkpoint_write, &os);
+
+  os << *tile;
+  os.close();
+
+  fprintf(stderr, "Saved checkpoint %s at cycle %llu\n", filename,
+          (unsigned long long)trace_count);
+}
+
+static bool restore_checkpoint(const char* filename, TEST_HARNESS* tile,
+                               bool fast_load, int htif_argc, char** htif_argv)
+{
+  VerilatedRestore is;
+  is.open(filename);
+  if (!is.isOpen()) {
+    std::cerr << "Unable to open " << filename << " for checkpoint read\n";
+    return false;
+  }
+
+  char magic[sizeof(checkpoint_magic)];
+  is.read(magic, sizeof(magic));
+  if (memcmp(magic, checkpoint_magic, sizeof(magic)) != 0) {
+    std::cerr << filename << " is not an emulator checkpoint\n";
+    return false;
+  }
+
+  uint64_t cycle;
+  is.read(&cycle, sizeof(cycle));
+
+  // The logged debug_tick inputs only make sense for the HTIF session that
+  // produced them, so the run must load the program the same way, queue
+  // DMI operations the same way, and be given the same arguments.
+  bool saved_fast_load;
+  is.read(&saved_fast_load, sizeof(saved_fast_load));
+  if (saved_fast_load != fast_load) {
+    std::cerr << filename << " was saved by a run " << (saved_fast_load ? "with" : "without")
+              << " --fast-load\n";
+    return false;
+  }
+  uint32_t saved_depth;
+  is.read(&saved_depth, sizeof(saved_depth));
+  if (saved_depth != dtm_queue_depth()) {
+    std::cerr << filename << " was saved by a run with --dmi-queue=" << saved_depth << "\n";
+    return false;
+  }
+  uint32_t saved_idle_skip;
+  is.read(&saved_idle_skip, sizeof(saved_idle_skip));
+  if (saved_idle_skip != dtm_idle_skip()) {
+    std::cerr << filename << " was saved by a run with --dmi-idle-skip=" << saved_idle_skip << "\n";
+    return false;
+  }
+
+  uint32_t nargs;
+  is.read(&nargs, sizeof(nargs));
+  bool args_match = nargs == (uint32_t)(htif_argc - 1);
+  for (uint32_t i = 0; i < nargs; i++) {
+    uint32_t len;
+    is.read(&len, sizeof(len));
+    std::string arg(len, '\0');
+    is.read(&arg[0], len);
+    if (args_match && arg != htif_argv[i + 1])
+      args_match = false;
+  }
+  if (!args_match) {
+    std::cerr << filename << " was saved by a run with different HOST or "
+              << "TARGET arguments\n";
+    return false;
+  }
+
+  remote_bitbang_t::snapshot_t jtag_state;
+  is.read(&jtag_state, sizeof(jtag_state));
+  jtag->restore(jtag_state);
+
+  uint64_t nruns;
+  is.read(&nruns, sizeof(nruns));
+  std::vector<dtm_tick_run_t> log(nruns);
+  if (nruns)
+    is.read(log.data(), nruns * sizeof(dtm_tick_run_t));
+
+  // Replaying the HTIF session repeats whatever the target printed before
+  // the checkpoint; send that to /dev/null. Its other proxied system calls
+  // (files opened, written, read, or seeked, stdin read) run again as they
+  // are, which --restore-checkpoint's help warns of.
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int devnull = open("/dev/null", O_WRONLY);
+  if (saved_stdout >= 0 && devnull >= 0)
+    dup2(devnull, STDOUT_FILENO);
+  dtm_replay(log);
+  fflush(stdout);
+  if (saved_stdout >= 0 && devnull >= 0)
+    dup2(saved_stdout, STDOUT_FILENO);
+  if (devnull >= 0) close(devnull);
+  if (saved_stdout >= 0) close(saved_stdout);
+
+  sim_dram_restore(checkpoint_read, &is);
+
+  is >> *tile;
+  is.close();
+
+  trace_count = cycle;
+  fprintf(stderr, "Restored checkpoint %s at cycle %llu\n", filename,
+          (unsigned long long)trace_count);
+  return true;
+}
+#endif
+
 static void usage(const char * program_name)
 {
   printf("Usage: %s [EMULATOR OPTION]... [VERILOG PLUSARG]... [HOST OPTION]... BINARY [TARGET OPTION]...\n",
@@ -74,15 +389,105 @@ Mandatory arguments to long options are mandatory for short options too.\n\
 EMULATOR OPTIONS\n\
   -c, --cycle-count        Print the cycle count before exiting\n\
        +cycle-count\n\
+      --commit-log=FILE    Write the commit log to FILE in binary (see\n\
+                           commit_log_decode); needs a config with\n\
+                           WithCommitLog, such as CosimConfig\n\
+      --cosim[=ISA]        Step spike along with the model and stop at the\n\
+                           first instruction where they differ (see cosim.h);\n\
+                           needs an emulator built with COSIM=1 from a config\n\
+                           with WithCommitLog, such as CosimConfig\n\
+                           [default ISA RV64IMAFDC]\n\
+      --cosim-ram=BASE:SIZE\n\
+                           Where spike has RAM [default 0x80000000:0x10000000]\n\
+      --cpus=LIST          Pin the main thread and then each of the model's\n\
+                           worker threads to the CPUs in LIST (e.g. 0-3,8),\n\
+                           one CPU per thread\n\
+      --dmi-idle-skip=CYCLES\n\
+                           Between polls of tohost, leave the debug module\n\
+                           alone for CYCLES cycles instead of sending it\n\
+                           fesvr's NOPs. Faster, but it changes when tohost\n\
+                           is polled, and so cycle counts [default 0: off]\n\
+      --dmi-queue=N        Queue up to N debug module operations, answering\n\
+                           writes before the debug module does (it still\n\
+                           gets them one at a time); 1 waits for each one\n\
+                           [default 16]\n\
+      --dram-config=FILE   Time the SimDRAM memory with a DRAM model (banks,\n\
+                           row buffers, refresh, a bandwidth cap) set up by\n\
+                           FILE (see dram_timing.h and emulator/dram.cfg);\n\
+                           needs a model built WithSimDRAM. A restored\n\
+                           checkpoint keeps the timing it was saved with\n\
+      --dram-stats=FILE    On exit, write the DRAM model's latency\n\
+                           histograms, row hits and bus use to FILE as JSON\n\
+      --fast-load          Write the program straight into the test harness\n\
+                           memory before reset instead of loading it through\n\
+                           the debug module\n\
   -h, --help               Display this help and exit\n\
   -m, --max-cycles=CYCLES  Kill the emulation after CYCLES\n\
        +max-cycles=CYCLES\n\
+      --numa-node=NODE     Allocate memory on NUMA node NODE, and unless\n\
+                           --cpus is given, pin the threads to its CPUs,\n\
+                           separate cores first\n\
+      --perf-interval=CYCLES\n\
+                           Take --perf-samples every CYCLES cycles\n\
+                           [default 10000]\n\
+      --perf-samples=FILE  Write each core's mcycle, minstret, IPC, HPM\n\
+                           counters and a count of every event they can\n\
+                           select to FILE as CSV, or JSON if FILE ends in\n\
+                           .json, every --perf-interval cycles, if the\n\
+                           config has WithSimPerfMonitor (see\n\
+                           SimPerfMonitor.h)\n\
+      --profile=FILE       Sample each hart's PC and call stack every\n\
+                           --profile-interval cycles from when the target\n\
+                           starts, and write a flat profile of the functions\n\
+                           of the program (and of what pk runs) to FILE;\n\
+                           needs an emulator built with PC_PROFILE=1\n\
+      --profile-folded=FILE\n\
+                           Write the sampled stacks to FILE in the folded\n\
+                           format of flamegraph.pl (see pc_profile.h)\n\
+      --profile-interval=CYCLES\n\
+                           Sample every CYCLES cycles [default 1000]\n\
+      --progress=CYCLES    Print simulation speed, time in the model and in\n\
+                           DPI calls, instructions retired, and memory use to\n\
+                           stderr every CYCLES cycles\n\
+      --progress-seconds=SECONDS\n\
+                           Print the same every SECONDS seconds\n\
   -s, --seed=SEED          Use random number seed SEED\n\
   -r, --rbb-port=PORT      Use PORT for remote bit bang (with OpenOCD and GDB) \n\
                            If not specified, a random port will be chosen\n\
                            automatically.\n\
+      --rbb-socket=PATH    Listen for remote bit bang on the Unix-domain\n\
+                           socket PATH instead of a TCP port\n\
+      --rbb-shm=NAME       Take remote bit bang from a client through the\n\
+                           shared memory file /dev/shm/NAME (see rbb_shm.h)\n\
+                           instead of a socket\n\
+      --rbb-wait=POLICY    Pause the simulation until a remote bit bang client\n\
+                           connects: never, first (only for the first\n\
+                           client), or always (whenever none is connected)\n\
+                           [default first]\n\
   -V, --verbose            Enable all Chisel printfs (cycle-by-cycle info)\n\
        +verbose\n\
+      --verbose-start=CYCLE\n\
+       +verbose-start=CYCLE  Enable them from CYCLE on (implies --verbose)\n\
+      --verbose-end=CYCLE  Disable them again at CYCLE (implies --verbose)\n\
+       +verbose-end=CYCLE\n\
+      --verbose-modules=PATTERNS\n\
+       +verbose-modules=PATTERNS\n\
+                           Enable only the printfs of the modules whose names\n\
+                           match one of the comma-separated shell PATTERNS\n\
+                           (e.g. Rocket,FPU,*DCache*) (implies --verbose)\n\
+      --verbose-buffer=BYTES\n\
+                           Buffer BYTES of printf output before writing it;\n\
+                           0 writes each line as it comes [default 1048576]\n\
+      --stats-json=FILE    On exit, write the seed, cycle count, run time and\n\
+                           its split between construction, reset, program load\n\
+                           and run to FILE as JSON\n\
+      --fork-server=FILE   Reset the model once, then run each line of FILE\n\
+                           (HOST and TARGET arguments) in a forked copy of it,\n\
+                           and print a table of the results; needs a build\n\
+                           with VERILATOR_THREADS=1\n\
+      --fork-jobs=N        Run up to N --fork-server jobs at once [default 1]\n\
+      --fork-log-dir=DIR   Write each --fork-server job's output to\n\
+                           DIR/INDEX-NAME.log\n\
 ", stdout);
 #if VM_TRACE == 0
   fputs("\
@@ -91,9 +496,35 @@ EMULATOR DEBUG OPTIONS (only supported in debug build -- try `make debug`)\n",
         stdout);
 #endif
   fputs("\
-  -v, --vcd=FILE,          Write vcd trace to FILE (or '-' for stdout)\n\
+  -v, --vcd=FILE,          Write vcd trace to FILE (or '-' for stdout); a FILE\n\
+                           ending in .gz is gzip-compressed. The FST build\n\
+                           (`make debug`) writes FST instead; `make\n\
+                           debug-vcd` builds the VCD one\n\
   -x, --dump-start=CYCLE   Start VCD tracing at CYCLE\n\
        +dump-start\n\
+      --flight-recorder=CYCLES\n\
+                           Keep only about the last CYCLES cycles of the -v\n\
+                           trace, in memory, and write them to FILE only if\n\
+                           the run fails or times out, or on SIGUSR1\n\
+", stdout);
+#if VM_SAVABLE == 0
+  fputs("\
+\n\
+EMULATOR CHECKPOINT OPTIONS (only supported in savable build -- try\n\
+`make VERILATOR_SAVABLE=1`)\n",
+        stdout);
+#endif
+  fputs("\
+      --save-checkpoint=CYCLE,FILE\n\
+                           Save the model and host state to FILE at CYCLE\n\
+      --restore-checkpoint=FILE\n\
+                           Start from the state saved in FILE instead of\n\
+                           reset; HOST and TARGET arguments must match.\n\
+                           The restore replays the HTIF session up to the\n\
+                           checkpoint, so every system call the target made\n\
+                           through the host before then runs again: only\n\
+                           its console output is dropped, and files it\n\
+                           wrote or read are written or read a second time\n\
 ", stdout);
   fputs("\n" PLUSARG_USAGE_OPTIONS, stdout);
   fputs("\n" HTIF_USAGE_OPTIONS, stdout);
@@ -116,17 +547,86 @@ EMULATOR DEBUG OPTIONS (only supported in debug build -- try `make debug`)\n",
          );
 }
 
+// Values for long options that have no short form; kept below
+// HTIF_LONG_OPTIONS_OPTIND
+enum {
+  OPT_FAST_LOAD = 256,
+  OPT_FORK_SERVER,
+  OPT_FORK_JOBS,
+  OPT_FORK_LOG_DIR,
+  OPT_SAVE_CHECKPOINT,
+  OPT_RESTORE_CHECKPOINT,
+  OPT_PROGRESS,
+  OPT_PROGRESS_SECONDS,
+  OPT_STATS_JSON,
+  OPT_FLIGHT_RECORDER,
+  OPT_CPUS,
+  OPT_NUMA_NODE,
+  OPT_DMI_IDLE_SKIP,
+  OPT_DMI_QUEUE,
+  OPT_RBB_SOCKET,
+  OPT_RBB_WAIT,
+  OPT_RBB_SHM,
+  OPT_COMMIT_LOG,
+  OPT_COSIM,
+  OPT_COSIM_RAM,
+  OPT_VERBOSE_START,
+  OPT_VERBOSE_END,
+  OPT_VERBOSE_MODULES,
+  OPT_VERBOSE_BUFFER,
+  OPT_DRAM_CONFIG,
+  OPT_DRAM_STATS,
+  OPT_PERF_SAMPLES,
+  OPT_PERF_INTERVAL,
+  OPT_PROFILE,
+  OPT_PROFILE_FOLDED,
+  OPT_PROFILE_INTERVAL,
+};
+
 int main(int argc, char** argv)
 {
   unsigned random_seed = (unsigned)time(NULL) ^ (unsigned)getpid();
   uint64_t max_cycles = -1;
+  uint64_t verbose_start = 0;
+  uint64_t verbose_end = -1;
+  const char * verbose_modules = NULL;
+  size_t verbose_buffer = 1 << 20;
   int ret = 0;
   bool print_cycles = false;
+  bool fast_load = false;
+  const char * fork_jobs_file = NULL;
+  int fork_jobs = 1;
+  const char * fork_log_dir = NULL;
+  uint64_t progress_cycles = 0;
+  double progress_seconds = 0;
+  const char * stats_json = NULL;
+  const char * commit_log = NULL;
+  const char * cosim_isa = NULL;
+  const char * dram_config = NULL;
+  const char * dram_stats = NULL;
+  const char * perf_samples = NULL;
+  uint64_t perf_interval = 10000;
+  const char * profile_flat = NULL;
+  const char * profile_folded = NULL;
+  uint64_t profile_interval = 1000;
+  uint64_t cosim_ram_base = 0x80000000;
+  uint64_t cosim_ram_size = 0x10000000;
+  const char * cpus_list = NULL;
+  int numa_node = -1;
   // Port numbers are 16 bit unsigned integers. 
   uint16_t rbb_port = 0;
+  const char * rbb_socket = NULL;
+  const char * rbb_shm = NULL;
+  remote_bitbang_t::wait_policy_t rbb_wait = remote_bitbang_t::WAIT_FIRST;
 #if VM_TRACE
-  FILE * vcdfile = NULL;
+  const char * vcd_name = NULL;
   uint64_t start = 0;
+  uint64_t flight_cycles = 0;
+#endif
+#if VM_SAVABLE
+  const char * save_file = NULL;
+  uint64_t save_cycle = 0;
+  const char * restore_file = NULL;
 #endif
   char ** htif_argv = NULL;
   int verilog_plusargs_legal = 1;
@@ -134,14 +634,47 @@ int main(int argc, char** argv)
   while (1) {
     static struct option long_options[] = {
       {"cycle-count", no_argument,       0, 'c' },
+      {"commit-log",  required_argument, 0, OPT_COMMIT_LOG },
+      {"cosim",       optional_argument, 0, OPT_COSIM },
+      {"cosim-ram",   required_argument, 0, OPT_COSIM_RAM },
+      {"cpus",        required_argument, 0, OPT_CPUS },
+      {"dmi-idle-skip", required_argument, 0, OPT_DMI_IDLE_SKIP },
+      {"dmi-queue",   required_argument, 0, OPT_DMI_QUEUE },
+      {"dram-config", required_argument, 0, OPT_DRAM_CONFIG },
+      {"dram-stats",  required_argument, 0, OPT_DRAM_STATS },
+      {"fast-load",   no_argument,       0, OPT_FAST_LOAD },
+      {"fork-server", required_argument, 0, OPT_FORK_SERVER },
+      {"fork-jobs",   required_argument, 0, OPT_FORK_JOBS },
+      {"fork-log-dir", required_argument, 0, OPT_FORK_LOG_DIR },
       {"help",        no_argument,       0, 'h' },
       {"max-cycles",  required_argument, 0, 'm' },
+      {"numa-node",   required_argument, 0, OPT_NUMA_NODE },
+      {"perf-interval", required_argument, 0, OPT_PERF_INTERVAL },
+      {"perf-samples", required_argument, 0, OPT_PERF_SAMPLES },
+      {"profile",     required_argument, 0, OPT_PROFILE },
+      {"profile-folded", required_argument, 0, OPT_PROFILE_FOLDED },
+      {"profile-interval", required_argument, 0, OPT_PROFILE_INTERVAL },
+      {"progress",    required_argument, 0, OPT_PROGRESS },
+      {"progress-seconds", required_argument, 0, OPT_PROGRESS_SECONDS },
       {"seed",        required_argument, 0, 's' },
       {"rbb-port",    required_argument, 0, 'r' },
+      {"rbb-socket",  required_argument, 0, OPT_RBB_SOCKET },
+      {"rbb-wait",    required_argument, 0, OPT_RBB_WAIT },
+      {"rbb-shm",     required_argument, 0, OPT_RBB_SHM },
       {"verbose",     no_argument,       0, 'V' },
+      {"verbose-start", required_argument, 0, OPT_VERBOSE_START },
+      {"verbose-end", required_argument, 0, OPT_VERBOSE_END },
+      {"verbose-modules", required_argument, 0, OPT_VERBOSE_MODULES },
+      {"verbose-buffer", required_argument, 0, OPT_VERBOSE_BUFFER },
+      {"stats-json",  required_argument, 0, OPT_STATS_JSON },
 #if VM_TRACE
       {"vcd",         required_argument, 0, 'v' },
       {"dump-start",  required_argument, 0, 'x' },
+      {"flight-recorder", required_argument, 0, OPT_FLIGHT_RECORDER },
+#endif
+#if VM_SAVABLE
+      {"save-checkpoint",    required_argument, 0, OPT_SAVE_CHECKPOINT },
+      {"restore-checkpoint", required_argument, 0, OPT_RESTORE_CHECKPOINT },
 #endif
       HTIF_LONG_OPTIONS
     };
@@ -162,16 +695,72 @@ int main(int argc, char** argv)
       case 's': random_seed = atoi(optarg); break;
       case 'r': rbb_port = atoi(optarg);    break;
       case 'V': verbose = true;             break;
-#if VM_TRACE
-      case 'v': {
-        vcdfile = strcmp(optarg, "-") == 0 ? stdout : fopen(optarg, "w");
-        if (!vcdfile) {
-          std::cerr << "Unable to open " << optarg << " for VCD write\n";
+      case OPT_VERBOSE_START: verbose = true; verbose_start = atoll(optarg); break;
+      case OPT_VERBOSE_END: verbose = true; verbose_end = atoll(optarg); break;
+      case OPT_VERBOSE_MODULES: verbose = true; verbose_modules = optarg; break;
+      case OPT_VERBOSE_BUFFER: verbose_buffer = atoll(optarg); break;
+      case OPT_FAST_LOAD: fast_load = true; break;
+      case OPT_FORK_SERVER: fork_jobs_file = optarg; break;
+      case OPT_FORK_JOBS: fork_jobs = atoi(optarg); break;
+      case OPT_FORK_LOG_DIR: fork_log_dir = optarg; break;
+      case OPT_PROGRESS: progress_cycles = atoll(optarg); break;
+      case OPT_PROGRESS_SECONDS: progress_seconds = atof(optarg); break;
+      case OPT_STATS_JSON: stats_json = optarg; break;
+      case OPT_COMMIT_LOG: commit_log = optarg; break;
+      case OPT_COSIM: cosim_isa = optarg ? optarg : "RV64IMAFDC"; break;
+      case OPT_COSIM_RAM: {
+        char* end;
+        cosim_ram_base = strtoull(optarg, &end, 0);
+        if (*end == ':')
+          cosim_ram_size = strtoull(end + 1, &end, 0);
+        if (*end || !cosim_ram_size) {
+          std::cerr << "Invalid --cosim-ram " << optarg << "; expected BASE:SIZE\n";
           return 1;
         }
         break;
       }
+      case OPT_CPUS: cpus_list = optarg; break;
+      case OPT_NUMA_NODE: numa_node = atoi(optarg); break;
+      case OPT_DMI_IDLE_SKIP: dtm_set_idle_skip(atoi(optarg)); break;
+      case OPT_DMI_QUEUE: dtm_set_queue_depth(atoi(optarg)); break;
+      case OPT_DRAM_CONFIG: dram_config = optarg; break;
+      case OPT_DRAM_STATS: dram_stats = optarg; break;
+      case OPT_PERF_SAMPLES: perf_samples = optarg; break;
+      case OPT_PERF_INTERVAL: perf_interval = atoll(optarg); break;
+      case OPT_PROFILE: profile_flat = optarg; break;
+      case OPT_PROFILE_FOLDED: profile_folded = optarg; break;
+      case OPT_PROFILE_INTERVAL: profile_interval = atoll(optarg); break;
+      case OPT_RBB_SOCKET: rbb_socket = optarg; break;
+      case OPT_RBB_SHM: rbb_shm = optarg; break;
+      case OPT_RBB_WAIT:
+        if (!strcmp(optarg, "never"))
+          rbb_wait = remote_bitbang_t::WAIT_NEVER;
+        else if (!strcmp(optarg, "first"))
+          rbb_wait = remote_bitbang_t::WAIT_FIRST;
+        else if (!strcmp(optarg, "always"))
+          rbb_wait = remote_bitbang_t::WAIT_ALWAYS;
+        else {
+          std::cerr << "--rbb-wait must be never, first or always\n";
+          return 1;
+        }
+        break;
+#if VM_TRACE
+      case 'v': vcd_name = optarg;          break;
       case 'x': start = atoll(optarg);      break;
+      case OPT_FLIGHT_RECORDER: flight_cycles = atoll(optarg); break;
+#endif
+#if VM_SAVABLE
+      case OPT_SAVE_CHECKPOINT: {
+        char * comma;
+        save_cycle = strtoull(optarg, &comma, 0);
+        if (comma == optarg || *comma != ',' || !comma[1]) {
+          std::cerr << "--save-checkpoint expects CYCLE,FILE\n";
+          return 1;
+        }
+        save_file = comma + 1;
+        break;
+      }
+      case OPT_RESTORE_CHECKPOINT: restore_file = optarg; break;
 #endif
       // Process legacy '+' EMULATOR arguments by replacing them with
       // their getopt equivalents
@@ -183,6 +772,18 @@ int main(int argc, char** argv)
         }
         if (arg == "+verbose")
           c = 'V';
+        else if (arg.substr(0, 15) == "+verbose-start=") {
+          c = OPT_VERBOSE_START;
+          optarg = optarg+15;
+        }
+        else if (arg.substr(0, 13) == "+verbose-end=") {
+          c = OPT_VERBOSE_END;
+          optarg = optarg+13;
+        }
+        else if (arg.substr(0, 17) == "+verbose-modules=") {
+          c = OPT_VERBOSE_MODULES;
+          optarg = optarg+17;
+        }
         else if (arg.substr(0, 12) == "+max-cycles=") {
           c = 'm';
           optarg = optarg+12;
@@ -245,67 +846,266 @@ int main(int argc, char** argv)
   }
 
 done_processing:
-  if (optind == argc) {
+  if (fork_jobs_file) {
+#if defined(VERILATOR_THREADS) && VERILATOR_THREADS > 1
+    // fork() only copies the calling thread, so a child would wait forever
+    // on the model's worker threads.
+    std::cerr << "--fork-server needs an emulator built with VERILATOR_THREADS=1\n";
+    return 1;
+#endif
+    bool unsupported = fast_load || stats_json || dram_stats || commit_log || cosim_isa ||
+                       perf_samples || profile_flat || profile_folded;
+#if VM_TRACE
+    unsupported |= vcd_name != NULL;
+#endif
+#if VM_SAVABLE
+    unsupported |= save_file != NULL || restore_file != NULL;
+#endif
+    if (unsupported) {
+      std::cerr << "--fork-server cannot be combined with --fast-load, "
+                << "--stats-json, --dram-stats, --commit-log, --cosim, "
+                << "--perf-samples, --profile, tracing, or checkpoints\n";
+      return 1;
+    }
+  } else if (optind == argc) {
     std::cerr << "No binary specified for emulator\n";
     usage(argv[0]);
     return 1;
   }
+#ifndef PC_PROFILE
+  if (profile_flat || profile_folded) {
+    std::cerr << "--profile needs an emulator built with PC_PROFILE=1\n";
+    return 1;
+  }
+#endif
+  if (cosim_isa) {
+#ifndef COSIM
+    std::cerr << "--cosim needs an emulator built with COSIM=1\n";
+    return 1;
+#endif
+#if VM_SAVABLE
+    // Spike would have to start where the checkpoint left off.
+    if (restore_file) {
+      std::cerr << "--cosim cannot be combined with --restore-checkpoint\n";
+      return 1;
+    }
+#endif
+  }
+#if VM_TRACE
+  if (flight_cycles && !vcd_name) {
+    std::cerr << "--flight-recorder needs a trace file (-v)\n";
+    return 1;
+  }
+#if VM_TRACE_FST
+  if (vcd_name && strcmp(vcd_name, "-") == 0) {
+    std::cerr << "An FST trace cannot be written to stdout\n";
+    return 1;
+  }
+#endif
+#endif
+  if (verbose_modules && !printf_filter_modules(verbose_modules))
+    return 1;
+  if (dram_config && !sim_dram_configure(dram_config))
+    return 1;
+  if (perf_samples && perf_interval == 0) {
+    std::cerr << "--perf-interval must be at least 1\n";
+    return 1;
+  }
+  if ((profile_flat || profile_folded) && profile_interval == 0) {
+    std::cerr << "--profile-interval must be at least 1\n";
+    return 1;
+  }
+  printf_set_window(verbose_start, verbose_end);
+  if (verbose)
+    printf_buffer(verbose_buffer);
+
+  std::vector<int> cpus;
+  if (cpus_list && !cpu_list_parse(cpus_list, cpus)) {
+    std::cerr << "Invalid CPU list " << cpus_list << "\n";
+    return 1;
+  }
+  if (numa_node >= 0) {
+    if (!cpus_list && !cpu_list_numa_node(numa_node, cpus)) {
+      std::cerr << "Unable to find the CPUs of NUMA node " << numa_node << "\n";
+      return 1;
+    }
+    // The model allocates its state when it is constructed.
+    if (!numa_prefer_node(numa_node))
+      std::cerr << "Unable to prefer memory on NUMA node " << numa_node << "\n";
+  }
+
   int htif_argc = 1 + argc - optind;
   htif_argv = (char **) malloc((htif_argc) * sizeof (char *));
   htif_argv[0] = argv[0];
   for (int i = 1; optind < argc;) htif_argv[i++] = argv[optind++];
 
+  if (commit_log && !commit_log_open(commit_log)) {
+    std::cerr << "Unable to open " << commit_log << "\n";
+    return 1;
+  }
+  if (perf_samples && !perf_sample_open(perf_samples, perf_interval))
+    return 1;
+  if (profile_flat || profile_folded) {
+    // The program is the first argument that is not a host option; pk's
+    // program, and the rest of the arguments, may be ELF files too.
+    bool program = true;
+    pc_profile_open(profile_interval);
+    for (int i = 1; i < htif_argc; i++) {
+      if (htif_argv[i][0] == '-' || htif_argv[i][0] == '+')
+        continue;
+      if (!pc_profile_add_symbols(htif_argv[i]) && program)
+        std::cerr << "--profile: " << htif_argv[i] << " is not an ELF file; "
+                  << "its PCs will not be named\n";
+      program = false;
+    }
+  }
+#ifdef COSIM
+  if (cosim_isa) {
+    // The program is the first argument that is not a host option.
+    const char* program = NULL;
+    for (int i = 1; i < htif_argc && !program; i++)
+      if (htif_argv[i][0] != '-' && htif_argv[i][0] != '+')
+        program = htif_argv[i];
+    if (!program || !cosim_open(program, cosim_isa, cosim_ram_base, cosim_ram_size))
+      return 1;
+  }
+#endif
+
   if (verbose)
     fprintf(stderr, "using random seed %u\n", random_seed);
 
   srand(random_seed);
   srand48(random_seed);
 
+  auto start_time = std::chrono::steady_clock::now();
+  sim_stats_start(progress_cycles || progress_seconds > 0 || stats_json,
+                  progress_cycles, progress_seconds);
+
   Verilated::randReset(2);
   Verilated::commandArgs(argc, argv);
+  std::vector<pid_t> threads = thread_list();
   TEST_HARNESS *tile = new TEST_HARNESS;
+  if (!cpus.empty()) {
+    // The threads that constructing the model started are its workers;
+    // the main thread goes first.
+    std::vector<pid_t> model_threads = thread_list();
+    std::vector<pid_t> pinned(1, getpid());
+    for (pid_t t : model_threads)
+      if (!std::binary_search(threads.begin(), threads.end(), t))
+        pinned.push_back(t);
+    if (cpus.size() < pinned.size())
+      std::cerr << "Only " << cpus.size() << " CPUs given for " << pinned.size()
+                << " threads; the rest are not pinned\n";
+    thread_pin(pinned, cpus);
+  }
 
 #if VM_TRACE
   Verilated::traceEverOn(true); // Verilator must compute traced signals
 
 #if VM_TRACE_FST
-  tfp = new VerilatedFstC;
-
-   if (vcdfile) {
-    tile->trace(tfp, 99);  // Trace 99 levels of hierarchy
-    tfp->open("dump.fst");
+   if (flight_cycles) {
+    // The recorder makes a trace for each segment when it starts.
+    recorder = new flight_recorder_t(vcd_name, flight_cycles);
+   } else {
+    tfp = new VerilatedFstC;
+    if (vcd_name) {
+      tile->trace(tfp, 99);  // Trace 99 levels of hierarchy
+      tfp->open(vcd_name);
+    }
    }
 
 #else
-  std::unique_ptr<VerilatedVcdFILE> vcdfd(new VerilatedVcdFILE(vcdfile));
-  tfp  = new VerilatedVcdC(vcdfd.get());
-   if (vcdfile) {
+  // Writes the trace from a background thread; see trace_writer.h.
+  std::unique_ptr<trace_writer_t> vcdfd(new trace_writer_t);
+  if (flight_cycles) {
+    recorder = new flight_recorder_t(vcd_name, flight_cycles);
+    tfp = new VerilatedVcdC(recorder);
+    tile->trace(tfp, 99);  // Trace 99 levels of hierarchy
+  } else {
+    tfp = new VerilatedVcdC(vcdfd.get());
+  }
+   if (vcd_name && !flight_cycles) {
 
     tile->trace(tfp, 99);  // Trace 99 levels of hierarchy
-//    tfp->open("");
+    tfp->open(vcd_name);
    }
 #endif
 
+  // The flight recorder only writes FILE when it has something to show.
+  if (vcd_name && !flight_cycles && !tfp->isOpen()) {
+    std::cerr << "Unable to open " << vcd_name << " for trace write\n";
+    return 1;
+  }
+
 #endif
 
-  jtag = new remote_bitbang_t(rbb_port);
-  dtm = new dtm_t(htif_argc, htif_argv);
+  // A fork server's children set up their own host side after the fork.
+  emulator_dtm_t* edtm = NULL;
+  if (!fork_jobs_file) {
+    jtag = new remote_bitbang_t(rbb_port, rbb_socket, rbb_wait, rbb_shm);
+    edtm = new emulator_dtm_t(htif_argc, htif_argv, fast_load);
+    dtm = edtm;
+  }
 
   signal(SIGTERM, handle_sigterm);
+  if (verbose && verbose_buffer)
+    signal(SIGABRT, handle_sigabrt);
+#if VM_TRACE
+  if (recorder) {
+    signal(SIGUSR1, handle_sigusr1);
+    signal(SIGABRT, handle_sigabrt);
+  }
+#endif
+
+  sim_stats_phase(SIM_PHASE_RESET, trace_count);
+  bool restored = false;
+#if VM_SAVABLE
+  if (save_file)
+    dtm_set_recording(true);
+  if (restore_file) {
+    if (!restore_checkpoint(restore_file, tile, fast_load, htif_argc, htif_argv))
+      return 1;
+    restored = true;
+    sim_stats_restored(trace_count);
+  }
+#endif
+  // Read the program into the backdoor image now, before the model is first
+  // evaluated, so that the harness memory takes it when it is initialized.
+  if (fast_load && !restored) {
+    sim_stats_phase(SIM_PHASE_LOAD, trace_count);
+    if (!edtm->preload())
+      return 1;
+    sim_stats_phase(SIM_PHASE_RESET, trace_count);
+  }
+
+#if VM_TRACE
+  if (recorder) {
+#if VM_TRACE_FST
+    recorder->start([tile]() {
+      VerilatedFstC* t = new VerilatedFstC;
+      tile->trace(t, 99);  // Trace 99 levels of hierarchy
+      return t;
+    }, trace_count);
+#else
+    recorder->start(tfp, trace_count);
+#endif
+    tfp = recorder->trace();
+  }
+#endif
 
   bool dump;
   // reset for several cycles to handle pipelined reset
-  for (int i = 0; i < 10; i++) {
+  for (int i = 0; i < 10 && !restored; i++) {
     tile->reset = 1;
     tile->clock = 0;
-    tile->eval();
+    eval_model(tile);
 #if VM_TRACE
     dump = tfp && trace_count >= start;
     if (dump)
       tfp->dump(static_cast<vluint64_t>(trace_count * 2));
 #endif
     tile->clock = 1;
-    tile->eval();
+    eval_model(tile);
 #if VM_TRACE
     if (dump)
       tfp->dump(static_cast<vluint64_t>(trace_count * 2 + 1));
@@ -314,11 +1114,44 @@ done_processing:
   }
   tile->reset = 0;
   done_reset = true;
+  sim_stats_phase(restored ? SIM_PHASE_RUN : SIM_PHASE_LOAD, trace_count);
+
+  if (fast_load && !restored && mem_backdoor_size() && !mem_backdoor_target()) {
+    std::cerr << "--fast-load: no memory in the model can hold the program; "
+              << "run without --fast-load\n";
+    return 1;
+  }
+  if ((dram_config || dram_stats) && !sim_dram_ports()) {
+    std::cerr << (dram_config ? "--dram-config" : "--dram-stats")
+              << " needs a model built WithSimDRAM\n";
+    return 1;
+  }
+  if (fork_jobs_file) {
+    free(htif_argv);
+    fork_server(fork_jobs_file, fork_jobs, fork_log_dir, argv[0],
+                &htif_argc, &htif_argv);
+    jtag = new remote_bitbang_t(rbb_port, rbb_socket, rbb_wait, rbb_shm);
+    edtm = new emulator_dtm_t(htif_argc, htif_argv, false);
+    dtm = edtm;
+  }
+  bool startup_reported = restored;
+  if (restored)
+    pc_profile_start();
+
+#if VM_SAVABLE
+  if (save_file && save_cycle <= trace_count) {
+    std::cerr << "--save-checkpoint cycle " << save_cycle
+              << " must be after the first cycle of this run (" << trace_count
+              << ")\n";
+    return 1;
+  }
+#endif
 
-  while (!dtm->done() && !jtag->done() &&
+  while (!dtm->done() && !jtag->done() && !cosim_stopped() &&
          !tile->io_success && trace_count < max_cycles) {
+    printf_cycle(verbose, trace_count);
     tile->clock = 0;
-    tile->eval();
+    eval_model(tile);
 #if VM_TRACE
     dump = tfp && trace_count >= start;
     if (dump)
@@ -326,21 +1159,46 @@ done_processing:
 #endif
 
     tile->clock = 1;
-    tile->eval();
+    eval_model(tile);
 #if VM_TRACE
     if (dump)
       tfp->dump(static_cast<vluint64_t>(trace_count * 2 + 1));
 #endif
     trace_count++;
-  }
-
+    if (sim_stats_enabled)
+      sim_stats_cycle(trace_count);
 #if VM_TRACE
-  if (tfp)
-    tfp->close();
-  if (vcdfile)
-    fclose(vcdfile);
+    if (recorder) {
+      recorder->tick(trace_count);
+      if (recorder_dump_requested) {
+        recorder_dump_requested = 0;
+        recorder->dump(trace_count, "SIGUSR1");
+      }
+      tfp = recorder->trace();
+    }
+#endif
+#if VM_SAVABLE
+    if (save_file && trace_count == save_cycle)
+      save_checkpoint(save_file, tile, fast_load, htif_argc, htif_argv);
 #endif
 
+    if (!startup_reported && edtm->target_started()) {
+      startup_reported = true;
+      pc_profile_start();
+      sim_stats_phase(SIM_PHASE_RUN, trace_count);
+      if (verbose || print_cycles || fast_load) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        if (fast_load)
+          fprintf(stderr, "Program loaded into %s (%zu bytes); ",
+                  mem_backdoor_target(), mem_backdoor_size());
+        else
+          fprintf(stderr, "Program loaded via the debug module; ");
+        fprintf(stderr, "target started at cycle %llu, %.3f s after model construction\n",
+                (unsigned long long)trace_count, elapsed.count());
+      }
+    }
+  }
+
   if (dtm->exit_code())
   {
     fprintf(stderr, "*** FAILED *** via dtm (code = %d, seed %d) after %lld cycles\n", dtm->exit_code(), random_seed, trace_count);
@@ -351,6 +1209,11 @@ done_processing:
     fprintf(stderr, "*** FAILED *** via jtag (code = %d, seed %d) after %lld cycles\n", jtag->exit_code(), random_seed, trace_count);
     ret = jtag->exit_code();
   }
+  else if (cosim_stopped())
+  {
+    fprintf(stderr, "*** FAILED *** via cosim (seed %d) after %lld cycles\n", random_seed, trace_count);
+    ret = 3;
+  }
   else if (trace_count == max_cycles)
   {
     fprintf(stderr, "*** FAILED *** via trace_count (timeout, seed %d) after %lld cycles\n", random_seed, trace_count);
@@ -360,6 +1223,37 @@ done_processing:
   {
     fprintf(stderr, "*** PASSED *** Completed after %lld cycles\n", trace_count);
   }
+  if (verbose || print_cycles)
+    sim_dram_print_stats();
+
+#if VM_TRACE
+  if (recorder && ret)
+    recorder->dump(trace_count, trace_count == max_cycles ? "timeout" : "failure");
+#if VM_TRACE_FST
+  // A flight recorder closes and deletes its own traces.
+  if (tfp && !recorder)
+#else
+  if (tfp)
+#endif
+    tfp->close();
+  if (recorder)
+    delete recorder;
+#endif
+
+  if (stats_json)
+    sim_stats_write_json(stats_json, random_seed, trace_count, ret);
+  if (dram_stats)
+    sim_dram_write_stats(dram_stats);
+
+  commit_log_close();
+  perf_sample_close();
+  if (profile_flat || profile_folded)
+    pc_profile_write(profile_flat, profile_folded);
+#ifdef COSIM
+  cosim_close(verbose || print_cycles);
+#endif
+
+  fork_server_done(ret, trace_count);
 
   if (dtm) delete dtm;
   if (jtag) delete jtag;
@@ -0,0 +1,200 @@
+// See LICENSE.SiFive for license details.
+
+#include "flight_recorder.h"
+#include "trace_writer.h"
+
+#if VM_TRACE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+flight_recorder_t::flight_recorder_t(const char* filename, uint64_t cycles)
+  : filename(filename), tfp(NULL), next_cut(0)
+{
+  if (cycles < 1)
+    cycles = 1;
+#if VM_TRACE_FST
+  // Keep the segment being written and the complete one before it.
+  segment_cycles = cycles;
+  max_segments = 2;
+  const char* dir = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+  scratch_prefix = std::string(dir) + "/flight-recorder-" + std::to_string(getpid()) + "-";
+  scratch_count = 0;
+#else
+  // Smaller segments keep the window close to the requested length, at
+  // the cost of a full dump for each.
+  segment_cycles = (cycles + 3) / 4;
+  max_segments = 5;
+  in_header = false;
+#endif
+}
+
+flight_recorder_t::~flight_recorder_t()
+{
+#if VM_TRACE_FST
+  if (tfp) {
+    if (tfp->isOpen())
+      tfp->close();
+    delete tfp;
+  }
+  for (auto& seg : segments)
+    unlink(seg.data.c_str());
+#endif
+}
+
+#if VM_TRACE_FST
+void flight_recorder_t::start(new_trace_t f, uint64_t cycle)
+{
+  new_trace = f;
+  begin_segment(cycle);
+}
+#else
+void flight_recorder_t::start(trace_t* t, uint64_t cycle)
+{
+  tfp = t;
+  // Verilator writes the header into the file it opens first; openNext()
+  // then starts the first segment.
+  tfp->open(filename.c_str());
+  segments.push_back(segment_t());
+  segments.back().start = cycle;
+  tfp->openNext(false);
+  next_cut = cycle + segment_cycles;
+}
+#endif
+
+#if VM_TRACE_FST
+void flight_recorder_t::begin_segment(uint64_t cycle)
+{
+  segment_t seg;
+  seg.start = cycle;
+  seg.data = scratch_prefix + std::to_string(scratch_count++) + ".fst";
+  segments.push_back(seg);
+  tfp = new_trace();
+  tfp->open(seg.data.c_str());
+  while (segments.size() > max_segments) {
+    unlink(segments.front().data.c_str());
+    segments.pop_front();
+  }
+  next_cut = cycle + segment_cycles;
+}
+
+// Close the current segment and its trace.
+void flight_recorder_t::end_segment()
+{
+  tfp->close();
+  delete tfp;
+  tfp = NULL;
+}
+
+void flight_recorder_t::cut(uint64_t cycle)
+{
+  end_segment();
+  begin_segment(cycle);
+}
+#else
+void flight_recorder_t::cut(uint64_t cycle)
+{
+  segment_t seg;
+  seg.start = cycle;
+  // The segment must exist before openNext() opens it.
+  segments.push_back(seg);
+  tfp->openNext(false);
+  while (segments.size() > max_segments)
+    segments.pop_front();
+  next_cut = cycle + segment_cycles;
+}
+#endif
+
+#if VM_TRACE_FST
+static bool copy_file(const std::string& from, const std::string& to)
+{
+  FILE* in = fopen(from.c_str(), "rb");
+  if (!in)
+    return false;
+  FILE* out = fopen(to.c_str(), "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+  char buf[1 << 16];
+  size_t n;
+  bool ok = true;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    ok &= fwrite(buf, 1, n, out) == n;
+  fclose(in);
+  ok &= fclose(out) == 0;
+  return ok;
+}
+
+void flight_recorder_t::dump(uint64_t cycle, const char* reason)
+{
+  // Finish the segment being written so that its file is complete, and
+  // carry on in a new one once the window has been copied out.
+  end_segment();
+
+  std::string prev = filename;
+  size_t dot = prev.find_last_of('.');
+  if (dot == std::string::npos || prev.find('/', dot) != std::string::npos)
+    prev += ".prev";
+  else
+    prev.insert(dot, ".prev");
+
+  size_t n = segments.size();
+  uint64_t first = segments[n - 1].start;
+  bool ok = copy_file(segments[n - 1].data, filename);
+  if (n >= 2) {
+    first = segments[n - 2].start;
+    ok &= copy_file(segments[n - 2].data, prev);
+  }
+  begin_segment(cycle);
+  if (!ok) {
+    fprintf(stderr, "Flight recorder: unable to write %s\n", filename.c_str());
+    return;
+  }
+  fprintf(stderr, "Flight recorder (%s): wrote cycles %llu-%llu to %s%s%s\n",
+          reason, (unsigned long long)first, (unsigned long long)cycle,
+          n >= 2 ? prev.c_str() : "", n >= 2 ? " and " : "", filename.c_str());
+}
+#else
+bool flight_recorder_t::open(const std::string& name)
+{
+  in_header = header.empty() && segments.empty();
+  return true;
+}
+
+void flight_recorder_t::close()
+{
+  in_header = false;
+}
+
+ssize_t flight_recorder_t::write(const char* bufp, ssize_t len)
+{
+  if (in_header)
+    header.append(bufp, len);
+  else if (!segments.empty())
+    segments.back().data.append(bufp, len);
+  return len;
+}
+
+void flight_recorder_t::dump(uint64_t cycle, const char* reason)
+{
+  tfp->flush();
+
+  trace_writer_t out;
+  if (!out.open(filename)) {
+    fprintf(stderr, "Flight recorder: unable to open %s for VCD write\n",
+            filename.c_str());
+    return;
+  }
+  out.write(header.data(), header.size());
+  for (auto& seg : segments)
+    out.write(seg.data.data(), seg.data.size());
+  out.close();
+  fprintf(stderr, "Flight recorder (%s): wrote cycles %llu-%llu to %s\n",
+          reason, (unsigned long long)segments.front().start,
+          (unsigned long long)cycle, filename.c_str());
+}
+#endif
+
+#endif
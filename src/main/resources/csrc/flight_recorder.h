@@ -0,0 +1,113 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#if VM_TRACE
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <stdint.h>
+
+#if VM_TRACE_FST
+#include "verilated_fst_c.h"
+#else
+#include "verilated_vcd_c.h"
+#endif
+
+// Keeps about the last N cycles of a trace and writes them to a file only
+// when asked to (see --flight-recorder in emulator.cc).
+//
+// The trace is cut into segments by reopening it at regular intervals, which
+// makes Verilator start each segment with a full dump of every signal, so
+// any run of consecutive segments is a waveform on its own. Segments older
+// than the window are dropped as new ones start.
+//
+// A VCD trace is kept in memory: this class is the trace's output file, and
+// a dump writes the header followed by the retained segments as one VCD
+// (gzip-compressed if FILE ends in ".gz").
+// FST traces are written by Verilator straight to a file and cannot be
+// spliced, so each FST segment is a file in a scratch directory (/dev/shm
+// when available) that covers N cycles. A dump copies the newest segment to
+// FILE and the one before it to FILE with ".prev" before the extension.
+// Each FST segment is written by a trace object of its own: VerilatedFstC
+// keeps its signal codes across open(), so a reopened one would write
+// files whose codes do not match their headers.
+class flight_recorder_t
+#if !VM_TRACE_FST
+  : public VerilatedVcdFile
+#endif
+{
+ public:
+#if VM_TRACE_FST
+  typedef VerilatedFstC trace_t;
+#else
+  typedef VerilatedVcdC trace_t;
+#endif
+
+  flight_recorder_t(const char* filename, uint64_t cycles);
+  ~flight_recorder_t();
+
+#if VM_TRACE_FST
+  // Start at cycle. new_trace returns a new trace with the model attached
+  // to it; the recorder owns the traces it makes.
+  typedef std::function<trace_t*()> new_trace_t;
+  void start(new_trace_t new_trace, uint64_t cycle);
+#else
+  // Open tfp, which the model has been attached to, at cycle.
+  void start(trace_t* tfp, uint64_t cycle);
+#endif
+
+  // The trace to dump the model into. For FST it changes at each new
+  // segment, that is, after tick() or dump().
+  trace_t* trace() const { return tfp; }
+
+  // Called after each cycle; starts a new segment when one is due.
+  void tick(uint64_t cycle)
+  {
+    if (cycle >= next_cut)
+      cut(cycle);
+  }
+
+  // Write the retained window, which ends at cycle, to the output file.
+  void dump(uint64_t cycle, const char* reason);
+
+#if !VM_TRACE_FST
+  bool open(const std::string& name) override;
+  void close() override;
+  ssize_t write(const char* bufp, ssize_t len) override;
+#endif
+
+ private:
+  struct segment_t
+  {
+    uint64_t start;
+    std::string data; // VCD: the trace text; FST: the scratch file
+  };
+
+  void cut(uint64_t cycle);
+#if VM_TRACE_FST
+  void begin_segment(uint64_t cycle);
+  void end_segment();
+#endif
+
+  std::string filename;
+  trace_t* tfp;
+  uint64_t segment_cycles;
+  size_t max_segments;
+  uint64_t next_cut;
+  std::deque<segment_t> segments;
+#if VM_TRACE_FST
+  new_trace_t new_trace;
+  std::string scratch_prefix;
+  uint64_t scratch_count;
+#else
+  std::string header;
+  bool in_header;
+#endif
+};
+
+#endif
+
+#endif
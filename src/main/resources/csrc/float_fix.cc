@@ -1,11 +1,25 @@
 // See LICENSE.Berkeley for license details.
 
-#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
-#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "float_fix.h"
 
 
 // float_fix - Scott Beamer, 2015
@@ -20,115 +34,383 @@
 // log from spike, this tools attempts to fix that corner case. This tool will
 // only overwrite the log to hold the unrecoded float if that change will cause
 // it to match with the spike log (conservative).
+//
+// Logs run to tens of GB, so both are mapped and the rocket log is compared
+// in chunks on several threads. Stretches where the logs are the same are
+// compared with memcmp; only lines that differ get parsed. With
+// --first-divergence, nothing is written but the first line that still
+// differs after fixing, and the exit status says whether there was one.
+
+
+// A log, mapped if it is a regular file and read whole otherwise.
+class Log {
+ public:
+  explicit Log(const std::string &filename) : data_(nullptr), size_(0), map_(nullptr) {
+    int fd = filename == "-" ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cout << "Couldn't open file " << filename << std::endl;
+      std::exit(-2);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        map_ = map;
+        data_ = static_cast<const char*>(map);
+        size_ = st.st_size;
+      }
+    }
+    if (!map_) {
+      char buf[1 << 16];
+      ssize_t n;
+      while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0) {
+          std::cout << "Couldn't read file " << filename << std::endl;
+          std::exit(-2);
+        }
+        contents_.insert(contents_.end(), buf, buf + n);
+      }
+      data_ = contents_.data();
+      size_ = contents_.size();
+    }
+    if (fd != STDIN_FILENO)
+      close(fd);
+  }
+
+  ~Log() {
+    if (map_)
+      munmap(map_, size_);
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Offset of the end of the line starting at pos, its newline or the end
+  // of the log.
+  size_t LineEnd(size_t pos) const {
+    const void *nl = memchr(data_ + pos, '\n', size_ - pos);
+    return nl ? static_cast<const char*>(nl) - data_ : size_;
+  }
+
+  // Offset of the line after the one that pos is in.
+  size_t NextLine(size_t pos) const {
+    return std::min(size_, LineEnd(pos) + 1);
+  }
 
+  // Count the newlines in every kBlockSize block of the log, on up to jobs
+  // threads, so that LineStart() can find lines without going through the
+  // whole log.
+  void IndexLines(unsigned jobs);
 
-// Returns the bits in x[high:low] in the lowest positions
-uint64_t BitRange(uint64_t x, int high, int low) {
-  int high_gap = 63 - high;
-  return x << high_gap >> (low + high_gap);
+  // Offset of line number n, counting from 0, or size() if the log has
+  // fewer lines.
+  size_t LineStart(uint64_t n) const;
+
+  static const size_t kBlockSize = 1 << 20;
+
+ private:
+  const char *data_;
+  size_t size_;
+  void *map_;
+  std::vector<char> contents_;
+  // lines_before_[i] is the number of newlines before block i
+  std::vector<uint64_t> lines_before_;
+};
+
+
+// Run f(0) .. f(n-1) on up to jobs threads.
+template <typename F>
+void RunJobs(unsigned jobs, size_t n, F f) {
+  if (jobs <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; i++)
+      f(i);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < std::min<size_t>(jobs, n); t++) {
+    threads.emplace_back([&]() {
+      for (size_t i; (i = next++) < n; )
+        f(i);
+    });
+  }
+  for (auto &t : threads)
+    t.join();
 }
 
 
-// Returns uint64_t from the hex encoding within s offset by index
-uint64_t UIntFromHexSubstring(std::string s, int index) {
-  uint64_t x = strtoull(s.c_str() + index, nullptr, 16);
-  assert(errno == 0);
-  return x;
+static uint64_t CountNewlines(const char *p, size_t len) {
+  uint64_t count = 0;
+  const char *end = p + len;
+  while ((p = static_cast<const char*>(memchr(p, '\n', end - p)))) {
+    count++;
+    p++;
+  }
+  return count;
 }
 
 
-// Is commit line for a fld instruction?
-bool LineIsFLDInst(std::string line) {
-  uint32_t inst_bits = UIntFromHexSubstring(line, 22);
-  uint32_t width_field = (inst_bits >> 12) & 7;
-  uint32_t opcode_field = inst_bits & 127;
-  return (width_field == 3) && (opcode_field == 7);
+void Log::IndexLines(unsigned jobs) {
+  size_t blocks = (size_ + kBlockSize - 1) / kBlockSize;
+  lines_before_.assign(blocks + 1, 0);
+  RunJobs(jobs, blocks, [&](size_t i) {
+    size_t begin = i * kBlockSize;
+    lines_before_[i + 1] = CountNewlines(data_ + begin, std::min(kBlockSize, size_ - begin));
+  });
+  for (size_t i = 0; i < blocks; i++)
+    lines_before_[i + 1] += lines_before_[i];
 }
 
 
-// Is number possibly a recoded float inside double (upper 31 bits set)?
-bool NestedFloatPossible(uint64_t raw_input) {
-  const uint64_t mask = 0xfffffffe00000000;
-  return (raw_input & mask) == mask;
+size_t Log::LineStart(uint64_t n) const {
+  if (n == 0)
+    return 0;
+  // The block holding the n-th newline, which ends line n - 1.
+  size_t block = std::lower_bound(lines_before_.begin(), lines_before_.end(), n) -
+                 lines_before_.begin();
+  if (block == lines_before_.size())
+    return size_;
+  block--;
+  const char *p = data_ + block * kBlockSize;
+  for (uint64_t i = lines_before_[block]; i < n; i++)
+    p = static_cast<const char*>(memchr(p, '\n', data_ + size_ - p)) + 1;
+  return p - data_;
 }
 
 
-// Unrecodes a single float within a double
-//   uses magic numbers since can only handle float
-//   logic from berkeley-hardfloat/src/main/scala/recodedFloatNToFloatN.scala
-uint64_t UnrecodeFloatFromDouble(uint64_t raw_input) {
-  uint64_t recoded_float = raw_input & 0x1ffffffff;  // lower 33 bits
-  uint64_t sign = BitRange(recoded_float, 32, 32);
-  uint64_t exp_in = BitRange(recoded_float, 31, 23);
-  uint64_t sig_in = BitRange(recoded_float, 22, 0);
-
-  bool is_high_subnormal_in = BitRange(exp_in, 6, 0) < 2;
-  bool is_subnormal = (BitRange(exp_in, 8, 6) == 1) ||
-                     ((BitRange(exp_in, 8, 7) == 1) && is_high_subnormal_in);
-  bool is_normal = (BitRange(exp_in, 8, 7) == 1) && !is_high_subnormal_in ||
-                   (BitRange(exp_in, 8, 7) == 2);
-  bool is_special = BitRange(exp_in, 8, 7) == 3;
-  bool is_NaN = is_special && BitRange(exp_in, 6, 6);
-
-  uint64_t denorm_shift_dist = 2 - BitRange(exp_in, 4, 0);
-  uint64_t subnormal_sig_out = (0x400000 | sig_in) >> denorm_shift_dist;
-  uint8_t normal_exp_out = BitRange(exp_in, 7, 0) - 129;
-
-  uint64_t exp_out = is_normal ? normal_exp_out : (is_special ? 255 : 0);
-  uint64_t sig_out = is_normal || is_NaN ? sig_in :
-                     is_subnormal ? subnormal_sig_out : 0;
-
-  uint64_t raw_output64 = (sign << 31) | (exp_out << 23) | sig_out;
-  // assert((raw_output64 & 0xffffffff00000000) == uint64_t(0));
-  // If this is not a recoded float, this will return gibberish, however,
-  // the output will not match spike and thus the replacement will not happen.
-  return raw_output64;
+// A stretch of the rocket log, starting and ending on line boundaries, and
+// what was found in it.
+struct Chunk {
+  size_t begin, end;
+  // Replacement text for lines with fixes, by where the line starts in the
+  // rocket log. The newlines stay where they are.
+  std::vector<std::pair<size_t, std::string>> fixes;
+  // For --first-divergence, where the first line that still differs after
+  // fixing starts, in each log (SIZE_MAX if there are none).
+  size_t rocket_divergence, lspike_divergence;
+};
+
+
+// Compare a chunk of the rocket log against the same lines of the spike
+// log, which start at lspike_pos. Whole runs of lines are compared at once
+// with memcmp; only lines that differ are parsed.
+static void DiffChunk(const Log &rocket, const Log &lspike, size_t lspike_pos,
+                      bool stop_at_divergence, Chunk *chunk) {
+  const size_t kStride = 4096;
+  const char *r = rocket.data();
+  const char *s = lspike.data();
+  size_t pos = chunk->begin;
+  chunk->rocket_divergence = chunk->lspike_divergence = SIZE_MAX;
+
+  while (pos < chunk->end && lspike_pos < lspike.size()) {
+    // Skip ahead over everything the two logs have in common.
+    size_t n = std::min(chunk->end - pos, lspike.size() - lspike_pos);
+    size_t same = 0;
+    while (same < n) {
+      size_t stride = std::min(kStride, n - same);
+      if (memcmp(r + pos + same, s + lspike_pos + same, stride) != 0)
+        break;
+      same += stride;
+    }
+    while (same < n && r[pos + same] == s[lspike_pos + same])
+      same++;
+    if (same == n && n == chunk->end - pos &&
+        (r[pos + n - 1] == '\n' || lspike_pos + n == lspike.size() ||
+         s[lspike_pos + n] == '\n'))
+      return;
+    if (same == n && r[pos + n - 1] == '\n') {
+      // The spike log ends here.
+      pos += n;
+      lspike_pos += n;
+      break;
+    }
+
+    // Back up to the start of the line the logs part ways in.
+    size_t line = same;
+    while (line > 0 && r[pos + line - 1] != '\n')
+      line--;
+    pos += line;
+    lspike_pos += line;
+    size_t rocket_end = rocket.LineEnd(pos);
+    size_t lspike_end = lspike.LineEnd(lspike_pos);
+    std::string rocket_line(r + pos, rocket_end - pos);
+    std::string lspike_line(s + lspike_pos, lspike_end - lspike_pos);
+    if (FixLine(&rocket_line, lspike_line)) {
+      chunk->fixes.emplace_back(pos, rocket_line);
+    } else if (rocket_line != lspike_line && stop_at_divergence) {
+      chunk->rocket_divergence = pos;
+      chunk->lspike_divergence = lspike_pos;
+      return;
+    }
+    pos = rocket.NextLine(pos);
+    lspike_pos = lspike.NextLine(lspike_pos);
+  }
+
+  // The spike log ran out first.
+  if (pos < chunk->end && stop_at_divergence) {
+    chunk->rocket_divergence = pos;
+    chunk->lspike_divergence = lspike.size();
+  }
+}
+
+
+static void WriteAll(const char *p, size_t len) {
+  while (len) {
+    ssize_t n = write(STDOUT_FILENO, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      perror("float_fix: write");
+      std::exit(-3);
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+
+// Write a chunk of the rocket log out with its fixes in place.
+static void WriteChunk(const Log &rocket, const Chunk &chunk) {
+  size_t pos = chunk.begin;
+  for (auto &fix : chunk.fixes) {
+    WriteAll(rocket.data() + pos, fix.first - pos);
+    WriteAll(fix.second.data(), fix.second.size());
+    pos = fix.first + fix.second.size();
+  }
+  WriteAll(rocket.data() + pos, chunk.end - pos);
+}
+
+
+// Print the line of each log at a divergence, with its line number.
+static void ReportDivergence(const Log &rocket, const Log &lspike,
+                             size_t rocket_pos, size_t lspike_pos,
+                             uint64_t line_number) {
+  size_t rocket_end = rocket.LineEnd(rocket_pos);
+  printf("Logs diverge at line %" PRIu64 "\n", line_number + 1);
+  printf("rocket: %.*s\n", static_cast<int>(rocket_end - rocket_pos), rocket.data() + rocket_pos);
+  if (lspike_pos == lspike.size()) {
+    printf("lspike: (end of log)\n");
+  } else {
+    size_t lspike_end = lspike.LineEnd(lspike_pos);
+    printf("lspike: %.*s\n", static_cast<int>(lspike_end - lspike_pos), lspike.data() + lspike_pos);
+  }
 }
 
 
-// Best effort at replacing the float writeback with unrecoded version
-//   will only replace if (all of following met):
-//   - log lines differ between rocket and lspike
-//   - log line is a fld instruction
-//   - unrecoding the writeback data as a single float makes them match
-void DiffAndFix(std::string rocket_filename, std::string lspike_filename) {
-  if (rocket_filename == "-")
-    rocket_filename = "/dev/stdin";
-  std::ifstream rocket_log(rocket_filename);
-  if (!rocket_log.is_open()) {
-    std::cout << "Couldn't open file " << rocket_filename << std::endl;
-    std::exit(-2);
-  }
-  std::ifstream lspike_log(lspike_filename);
-  if (!lspike_log.is_open()) {
-    std::cout << "Couldn't open file " << lspike_filename << std::endl;
-    std::exit(-2);
-  }
-  std::string rocket_line, lspike_line;
-  while (getline(rocket_log, rocket_line)) {
-    if (getline(lspike_log, lspike_line) && (rocket_line != lspike_line) &&
-        LineIsFLDInst(rocket_line)) {
-      std::string fixed_line(rocket_line.c_str());  // deep copy
-      uint64_t raw_fp = UIntFromHexSubstring(fixed_line, 40);
-      if (NestedFloatPossible(raw_fp)) {
-        snprintf(const_cast<char*>(fixed_line.data()) + 40, 17,
-                 "%016" PRIx64, UnrecodeFloatFromDouble(raw_fp));
-        if (fixed_line == lspike_line)
-          rocket_line = fixed_line;
+// Goes through the rocket log a round of chunks at a time: the chunks of a
+// round are compared on up to jobs threads, then written out in order.
+// Returns whether the logs diverged, for --first-divergence.
+bool DiffAndFix(const std::string &rocket_filename, const std::string &lspike_filename,
+                unsigned jobs, bool first_divergence) {
+  const size_t kChunkSize = 4 << 20;
+  Log rocket(rocket_filename);
+  Log lspike(lspike_filename);
+  lspike.IndexLines(jobs);
+
+  size_t pos = 0;
+  uint64_t line_number = 0;
+  std::vector<Chunk> round(std::max(2u * jobs, 4u));
+  while (pos < rocket.size()) {
+    size_t chunks = 0;
+    for (; chunks < round.size() && pos < rocket.size(); chunks++) {
+      Chunk &chunk = round[chunks];
+      chunk.begin = pos;
+      chunk.end = pos = pos + kChunkSize >= rocket.size() ? rocket.size() :
+                        rocket.NextLine(pos + kChunkSize);
+      chunk.fixes.clear();
+    }
+
+    // Where each chunk starts in the spike log.
+    std::vector<uint64_t> first_line(chunks);
+    std::vector<size_t> lspike_pos(chunks);
+    RunJobs(jobs, chunks, [&](size_t i) {
+      first_line[i] = i == 0 ? 0 : CountNewlines(rocket.data() + round[i - 1].begin,
+                                                 round[i - 1].end - round[i - 1].begin);
+    });
+    for (size_t i = 0; i < chunks; i++) {
+      line_number += first_line[i];
+      first_line[i] = line_number;
+    }
+    RunJobs(jobs, chunks, [&](size_t i) {
+      lspike_pos[i] = lspike.LineStart(first_line[i]);
+      DiffChunk(rocket, lspike, lspike_pos[i], first_divergence, &round[i]);
+    });
+
+    for (size_t i = 0; i < chunks; i++) {
+      const Chunk &chunk = round[i];
+      if (!first_divergence) {
+        WriteChunk(rocket, chunk);
+      } else if (chunk.rocket_divergence != SIZE_MAX) {
+        ReportDivergence(rocket, lspike, chunk.rocket_divergence, chunk.lspike_divergence,
+                         first_line[i] + CountNewlines(rocket.data() + chunk.begin,
+                                                       chunk.rocket_divergence - chunk.begin));
+        return true;
       }
     }
-    printf("%s\n", rocket_line.c_str());
+    line_number += CountNewlines(rocket.data() + round[chunks - 1].begin,
+                                 round[chunks - 1].end - round[chunks - 1].begin);
+  }
+
+  // Every line goes out with a newline, the last one included.
+  if (rocket.size() && rocket.data()[rocket.size() - 1] != '\n') {
+    line_number++;
+    if (!first_divergence)
+      WriteAll("\n", 1);
   }
-  rocket_log.close();
-  lspike_log.close();
+
+  // The rocket log ran out first.
+  if (first_divergence && lspike.LineStart(line_number) < lspike.size()) {
+    size_t lspike_pos = lspike.LineStart(line_number);
+    size_t lspike_end = lspike.LineEnd(lspike_pos);
+    printf("Logs diverge at line %" PRIu64 "\n", line_number + 1);
+    printf("rocket: (end of log)\n");
+    printf("lspike: %.*s\n", static_cast<int>(lspike_end - lspike_pos), lspike.data() + lspike_pos);
+    return true;
+  }
+  return false;
+}
+
+
+static void Usage() {
+  std::cout << "Usage: float_fix [-j jobs] [--first-divergence] rocket_output lspike_output\n"
+            << "  -j, --jobs=N          threads to use (default: one per CPU)\n"
+            << "  --first-divergence    instead of writing the fixed log, report the\n"
+            << "                        first line that differs even after fixing" << std::endl;
 }
 
 
 int main(int argc, char** argv) {
-  if (argc != 3) {
-    std::cout << "Usage: float_fix rocket_output lspike_output" << std::endl;
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  bool first_divergence = false;
+
+  static struct option long_options[] = {
+    {"jobs", required_argument, nullptr, 'j'},
+    {"first-divergence", no_argument, nullptr, 'f'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "j:h", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'j':
+        jobs = std::max(1, atoi(optarg));
+        break;
+      case 'f':
+        first_divergence = true;
+        break;
+      default:
+        Usage();
+        return -1;
+    }
+  }
+  if (argc - optind != 2) {
+    Usage();
     return -1;
   }
-  DiffAndFix(std::string(argv[1]), std::string(argv[2]));
-  return 0;
+  bool diverged = DiffAndFix(std::string(argv[optind]), std::string(argv[optind + 1]),
+                             jobs, first_divergence);
+  return diverged ? 1 : 0;
 }
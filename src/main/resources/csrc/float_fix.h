@@ -0,0 +1,105 @@
+// See LICENSE.Berkeley for license details.
+
+#ifndef FLOAT_FIX_H
+#define FLOAT_FIX_H
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// The unrecoding fix of float_fix (see float_fix.cc), shared with
+// commit_log_decode.
+
+
+// Returns the bits in x[high:low] in the lowest positions
+inline uint64_t BitRange(uint64_t x, int high, int low) {
+  int high_gap = 63 - high;
+  return x << high_gap >> (low + high_gap);
+}
+
+
+// Returns uint64_t from the hex encoding within s offset by index
+inline uint64_t UIntFromHexSubstring(const std::string &s, int index) {
+  if (index > static_cast<int>(s.size()))
+    return 0;
+  return strtoull(s.c_str() + index, nullptr, 16);
+}
+
+
+// Is commit line for a fld instruction?
+inline bool LineIsFLDInst(const std::string &line) {
+  uint32_t inst_bits = UIntFromHexSubstring(line, 22);
+  uint32_t width_field = (inst_bits >> 12) & 7;
+  uint32_t opcode_field = inst_bits & 127;
+  return (width_field == 3) && (opcode_field == 7);
+}
+
+
+// Is number possibly a recoded float inside double (upper 31 bits set)?
+inline bool NestedFloatPossible(uint64_t raw_input) {
+  const uint64_t mask = 0xfffffffe00000000;
+  return (raw_input & mask) == mask;
+}
+
+
+// Unrecodes a single float within a double
+//   uses magic numbers since can only handle float
+//   logic from berkeley-hardfloat/src/main/scala/recodedFloatNToFloatN.scala
+inline uint64_t UnrecodeFloatFromDouble(uint64_t raw_input) {
+  uint64_t recoded_float = raw_input & 0x1ffffffff;  // lower 33 bits
+  uint64_t sign = BitRange(recoded_float, 32, 32);
+  uint64_t exp_in = BitRange(recoded_float, 31, 23);
+  uint64_t sig_in = BitRange(recoded_float, 22, 0);
+
+  bool is_high_subnormal_in = BitRange(exp_in, 6, 0) < 2;
+  bool is_subnormal = (BitRange(exp_in, 8, 6) == 1) ||
+                     ((BitRange(exp_in, 8, 7) == 1) && is_high_subnormal_in);
+  bool is_normal = (BitRange(exp_in, 8, 7) == 1) && !is_high_subnormal_in ||
+                   (BitRange(exp_in, 8, 7) == 2);
+  bool is_special = BitRange(exp_in, 8, 7) == 3;
+  bool is_NaN = is_special && BitRange(exp_in, 6, 6);
+
+  uint64_t denorm_shift_dist = 2 - BitRange(exp_in, 4, 0);
+  uint64_t subnormal_sig_out = (0x400000 | sig_in) >> denorm_shift_dist;
+  uint8_t normal_exp_out = BitRange(exp_in, 7, 0) - 129;
+
+  uint64_t exp_out = is_normal ? normal_exp_out : (is_special ? 255 : 0);
+  uint64_t sig_out = is_normal || is_NaN ? sig_in :
+                     is_subnormal ? subnormal_sig_out : 0;
+
+  uint64_t raw_output64 = (sign << 31) | (exp_out << 23) | sig_out;
+  // assert((raw_output64 & 0xffffffff00000000) == uint64_t(0));
+  // If this is not a recoded float, this will return gibberish, however,
+  // the output will not match spike and thus the replacement will not happen.
+  return raw_output64;
+}
+
+
+// Best effort at replacing the float writeback with unrecoded version
+//   will only replace if (all of following met):
+//   - log lines differ between rocket and lspike
+//   - log line is a fld instruction
+//   - unrecoding the writeback data as a single float makes them match
+// Returns whether rocket_line was replaced.
+inline bool FixLine(std::string *rocket_line, const std::string &lspike_line) {
+  if (*rocket_line == lspike_line || !LineIsFLDInst(*rocket_line) ||
+      rocket_line->size() < 40)
+    return false;
+  uint64_t raw_fp = UIntFromHexSubstring(*rocket_line, 40);
+  if (!NestedFloatPossible(raw_fp))
+    return false;
+  // The digits and their terminating NUL go over the line, as far as it
+  // goes.
+  char digits[17];
+  snprintf(digits, sizeof(digits), "%016" PRIx64, UnrecodeFloatFromDouble(raw_fp));
+  std::string fixed_line(*rocket_line);
+  for (size_t i = 0; i < sizeof(digits) && 40 + i < fixed_line.size(); i++)
+    fixed_line[40 + i] = digits[i];
+  if (fixed_line != lspike_line)
+    return false;
+  *rocket_line = fixed_line;
+  return true;
+}
+
+#endif
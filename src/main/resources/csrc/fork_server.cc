@@ -0,0 +1,203 @@
+// See LICENSE.SiFive for license details.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fork_server.h"
+
+// Shared with the children, which fill in their slot on the way out.
+struct fork_result_t
+{
+  int done;
+  int ret;
+  uint64_t cycles;
+};
+
+struct fork_job_t
+{
+  std::string name;
+  std::vector<std::string> args;
+};
+
+static fork_result_t* child_result = NULL;
+
+bool fork_server_child()
+{
+  return child_result != NULL;
+}
+
+void fork_server_done(int ret, uint64_t cycles)
+{
+  if (!child_result)
+    return;
+  child_result->ret = ret;
+  child_result->cycles = cycles;
+  child_result->done = 1;
+}
+
+static std::vector<fork_job_t> read_jobs(const char* jobs_file)
+{
+  std::ifstream in(jobs_file);
+  if (!in.is_open()) {
+    fprintf(stderr, "Unable to open %s for reading\n", jobs_file);
+    exit(1);
+  }
+
+  std::vector<fork_job_t> jobs;
+  std::string line;
+  while (getline(in, line)) {
+    std::istringstream words(line);
+    fork_job_t job;
+    std::string word;
+    while (words >> word)
+      job.args.push_back(word);
+    if (job.args.empty() || job.args[0][0] == '#')
+      continue;
+
+    // Name the job after its binary, the first argument that is not a
+    // HOST option.
+    for (auto& arg : job.args) {
+      if (arg[0] != '+' && arg[0] != '-') {
+        size_t slash = arg.find_last_of('/');
+        job.name = slash == std::string::npos ? arg : arg.substr(slash + 1);
+        break;
+      }
+    }
+    if (job.name.empty())
+      job.name = job.args[0];
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+static void start_child(size_t index, const fork_job_t& job, const char* log_dir,
+                        char* program_name, int* argc, char*** argv)
+{
+  int fd;
+  if (log_dir) {
+    // Jobs may run binaries with the same name, or the same binary twice.
+    std::string log = std::string(log_dir) + "/" + std::to_string(index) + "-" +
+                      job.name + ".log";
+    fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  } else {
+    fd = open("/dev/null", O_WRONLY);
+  }
+  if (fd >= 0) {
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+  }
+
+  *argc = 1 + job.args.size();
+  *argv = (char **) malloc((*argc) * sizeof (char *));
+  (*argv)[0] = program_name;
+  for (size_t i = 0; i < job.args.size(); i++)
+    (*argv)[i + 1] = strdup(job.args[i].c_str());
+}
+
+void fork_server(const char* jobs_file, int max_jobs, const char* log_dir,
+                 char* program_name, int* argc, char*** argv)
+{
+  std::vector<fork_job_t> jobs = read_jobs(jobs_file);
+  if (jobs.empty()) {
+    fprintf(stderr, "No jobs in %s\n", jobs_file);
+    exit(1);
+  }
+  if (max_jobs < 1)
+    max_jobs = 1;
+
+  fork_result_t* results = (fork_result_t*) mmap(NULL, jobs.size() * sizeof(fork_result_t),
+                                                 PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) {
+    fprintf(stderr, "fork server failed to map results: %s (%d)\n",
+            strerror(errno), errno);
+    exit(1);
+  }
+  memset(results, 0, jobs.size() * sizeof(fork_result_t));
+  std::vector<int> status(jobs.size(), 0);
+
+  fflush(stdout);
+  fflush(stderr);
+
+  std::map<pid_t, size_t> running;
+  size_t next = 0;
+  while (next < jobs.size() || !running.empty()) {
+    while (next < jobs.size() && running.size() < (size_t)max_jobs) {
+      pid_t pid = fork();
+      if (pid == 0) {
+        child_result = &results[next];
+        start_child(next, jobs[next], log_dir, program_name, argc, argv);
+        return;
+      }
+      if (pid < 0) {
+        fprintf(stderr, "fork server failed to fork: %s (%d)\n",
+                strerror(errno), errno);
+        if (running.empty())
+          exit(1);
+        break;
+      }
+      running[pid] = next++;
+    }
+
+    int wstatus;
+    pid_t pid = waitpid(-1, &wstatus, 0);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "fork server failed to wait: %s (%d)\n",
+              strerror(errno), errno);
+      exit(1);
+    }
+    auto it = running.find(pid);
+    if (it == running.end())
+      continue;
+    status[it->second] = wstatus;
+    running.erase(it);
+  }
+
+  size_t width = 0;
+  for (auto& job : jobs)
+    width = std::max(width, job.name.size());
+
+  size_t passed = 0;
+  fprintf(stderr, "\n");
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const fork_result_t& r = results[i];
+    bool ok = r.done && r.ret == 0 &&
+              WIFEXITED(status[i]) && WEXITSTATUS(status[i]) == 0;
+    passed += ok;
+
+    std::string detail;
+    if (WIFSIGNALED(status[i]))
+      detail = "killed by signal " + std::to_string(WTERMSIG(status[i]));
+    else if (!ok)
+      detail = "code " + std::to_string(r.done ? r.ret : WEXITSTATUS(status[i]));
+
+    fprintf(stderr, "  [%s] %-*s", ok ? " PASSED " : " FAILED ",
+            (int)width, jobs[i].name.c_str());
+    if (r.done)
+      fprintf(stderr, " %12llu cycles", (unsigned long long)r.cycles);
+    else
+      fprintf(stderr, " %12s       ", "-");
+    if (!detail.empty())
+      fprintf(stderr, "  (%s)", detail.c_str());
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr, "\n%zu of %zu jobs passed\n", passed, jobs.size());
+
+  exit(passed == jobs.size() ? 0 : 1);
+}
@@ -0,0 +1,29 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef FORK_SERVER_H
+#define FORK_SERVER_H
+
+#include <stdint.h>
+
+// Run every job in jobs_file from the current model state, each in its own
+// forked copy of this process, with at most max_jobs running at once. Each
+// line of jobs_file holds the HOST and TARGET arguments of one job; blank
+// lines and lines starting with '#' are skipped. If log_dir is set, a job's
+// stdout and stderr go to log_dir/INDEX-NAME.log, where INDEX counts the
+// jobs from 0 and NAME is the basename of the job's binary; otherwise they
+// are discarded.
+//
+// fork_server() only returns in a child, with *argc and *argv set up as the
+// HOST and TARGET arguments (argv[0] is program_name). The parent waits for
+// all jobs, prints a PASSED/FAILED table with cycle counts to stderr, and
+// exits with status 0 only if every job passed.
+void fork_server(const char* jobs_file, int max_jobs, const char* log_dir,
+                 char* program_name, int* argc, char*** argv);
+
+// True in a child started by fork_server().
+bool fork_server_child();
+
+// Tell the parent how a child's run ended.
+void fork_server_done(int ret, uint64_t cycles);
+
+#endif
@@ -0,0 +1,220 @@
+// See LICENSE.SiFive for license details.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mem_backdoor.h"
+
+static const uint64_t page_size = 4096;
+
+// The image, kept as whole pages; bytes of a page not written by the loader
+// are zero.
+static std::map<uint64_t, std::vector<uint8_t>> image;
+
+struct backdoor_mem_t
+{
+  std::string path;
+  uint64_t depth;
+  uint64_t row_bytes;
+  bool host;            // a host memory, holding [base, base + depth)
+  uint64_t base;        // the target address of row 0, once claimed
+  bool claimed;
+};
+
+static std::vector<backdoor_mem_t> mems;
+static bool chosen = false;
+static int target = -1;
+
+void mem_backdoor_write(uint64_t addr, size_t len, const void* src)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(src);
+  while (len > 0) {
+    uint64_t page = addr & ~(page_size - 1);
+    uint64_t offset = addr - page;
+    size_t n = std::min<uint64_t>(len, page_size - offset);
+
+    std::vector<uint8_t>& data = image[page];
+    if (data.empty())
+      data.resize(page_size, 0);
+    if (bytes)
+      memcpy(&data[offset], bytes, n);
+    else
+      memset(&data[offset], 0, n);
+
+    addr += n;
+    len -= n;
+    if (bytes)
+      bytes += n;
+  }
+}
+
+size_t mem_backdoor_size()
+{
+  return image.size() * page_size;
+}
+
+const char* mem_backdoor_target()
+{
+  return target >= 0 ? mems[target].path.c_str() : NULL;
+}
+
+// Is the memory at path inside the design under test (the test harness's
+// dut)? Those are caches, scratchpads and the like, which never hold the
+// program however well it would fit; the harness's own memories do.
+static bool in_dut(const std::string& path)
+{
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = path.find('.', start);
+    if (end == std::string::npos)
+      end = path.size();
+    if (path.compare(start, end - start, "dut") == 0)
+      return true;
+    start = end + 1;
+  }
+  return false;
+}
+
+// Can mem hold the whole image? Memories in the model are addressed by the
+// low bits of the target address, so the image has to fit in one naturally
+// aligned window of the memory's size.
+static bool holds_image(const backdoor_mem_t& mem, uint64_t* base)
+{
+  uint64_t lo = image.begin()->first;
+  uint64_t hi = image.rbegin()->first + page_size - 1;
+  if (mem.host) {
+    *base = mem.base;
+    return lo >= mem.base && hi - mem.base < mem.depth;
+  }
+
+  if (in_dut(mem.path))
+    return false;
+  if (mem.row_bytes == 0 || page_size % mem.row_bytes != 0)
+    return false;
+  if (mem.depth == 0 || (mem.depth & (mem.depth - 1)) != 0)
+    return false;
+
+  uint64_t bytes = mem.depth * mem.row_bytes;
+  *base = lo & ~(bytes - 1);
+  return hi - *base < bytes;
+}
+
+static uint64_t capacity(const backdoor_mem_t& mem)
+{
+  return mem.depth * mem.row_bytes;
+}
+
+// A host memory that holds the image takes it (they all share one store);
+// otherwise every largest harness memory that does, since with several
+// memory channels each serves its share of the addresses from the same
+// window.
+static void choose_target()
+{
+  chosen = true;
+  if (image.empty())
+    return;
+
+  std::vector<uint64_t> bases(mems.size());
+  std::vector<bool> holds(mems.size());
+  for (size_t i = 0; i < mems.size(); i++) {
+    holds[i] = holds_image(mems[i], &bases[i]);
+    if (!holds[i])
+      continue;
+    if (target < 0 || mems[i].host > mems[target].host ||
+        (mems[i].host == mems[target].host && capacity(mems[i]) > capacity(mems[target])))
+      target = i;
+  }
+  if (target < 0)
+    return;
+
+  for (size_t i = 0; i < mems.size(); i++) {
+    if ((int)i == target ||
+        (holds[i] && !mems[target].host && !mems[i].host &&
+         capacity(mems[i]) == capacity(mems[target]))) {
+      mems[i].claimed = true;
+      mems[i].base = bases[i];
+    }
+  }
+}
+
+extern "C" int mem_backdoor_attach(const char* path, long long depth, int width)
+{
+  if (image.empty() || width % 8 != 0)
+    return -1;
+
+  backdoor_mem_t mem;
+  mem.path = path;
+  mem.depth = depth;
+  mem.row_bytes = width / 8;
+  mem.host = false;
+  mem.base = 0;
+  mem.claimed = false;
+  mems.push_back(mem);
+  return mems.size() - 1;
+}
+
+int mem_backdoor_attach_host(const char* path, uint64_t base, uint64_t size)
+{
+  if (image.empty())
+    return -1;
+
+  backdoor_mem_t mem;
+  mem.path = path;
+  mem.depth = size;
+  mem.row_bytes = 1;
+  mem.host = true;
+  mem.base = base;
+  mem.claimed = false;
+  mems.push_back(mem);
+  return mems.size() - 1;
+}
+
+extern "C" int mem_backdoor_claim(int handle)
+{
+  if (!chosen)
+    choose_target();
+  return mems[handle].claimed;
+}
+
+// The first row at or after index that holds image data, or -1.
+extern "C" long long mem_backdoor_next(int handle, long long index)
+{
+  const backdoor_mem_t& mem = mems[handle];
+  uint64_t addr = mem.base + index * mem.row_bytes;
+  auto it = image.lower_bound(addr & ~(page_size - 1));
+  if (it == image.end())
+    return -1;
+  if (it->first > addr)
+    addr = it->first;
+  return (addr - mem.base) / mem.row_bytes;
+}
+
+// Bits [32*word+31:32*word] of row index.
+extern "C" int mem_backdoor_word(int handle, long long index, int word)
+{
+  const backdoor_mem_t& mem = mems[handle];
+  uint64_t addr = mem.base + index * mem.row_bytes + word * 4;
+  auto it = image.find(addr & ~(page_size - 1));
+  if (it == image.end())
+    return 0;
+
+  uint32_t bits = 0;
+  uint64_t offset = addr - it->first;
+  for (int i = 0; i < 4 && offset + i < page_size; i++)
+    bits |= uint32_t(it->second[offset + i]) << (8 * i);
+  return bits;
+}
+
+bool mem_backdoor_claim_host(int handle, void (*page)(uint64_t addr, const uint8_t* data, size_t len))
+{
+  if (handle < 0 || !mem_backdoor_claim(handle))
+    return false;
+  for (auto& it : image)
+    page(it.first, it.second.data(), page_size);
+  return true;
+}
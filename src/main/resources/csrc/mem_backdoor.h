@@ -0,0 +1,41 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef MEM_BACKDOOR_H
+#define MEM_BACKDOOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host-side program image for --fast-load.
+//
+// The emulator reads the program into the image before it first evaluates
+// the model. Memories generated by vlsi_mem_gen with MEM_BACKDOOR defined
+// register themselves with mem_backdoor_attach() when the model is
+// initialized, if there is an image. At the first clock edge, the largest
+// test harness memories that can hold the image (never one inside the
+// design under test, such as a cache) claim it and copy it into their
+// arrays, so the program is in place before reset is released without any
+// debug module traffic.
+//
+// Memories kept on the host rather than in the model (SimDRAM) take part
+// too, and one that holds the whole image is chosen over any memory in the
+// model.
+
+// Add len bytes at target address addr to the image.
+void mem_backdoor_write(uint64_t addr, size_t len, const void* src);
+
+// Number of bytes in the image (rounded up to whole pages).
+size_t mem_backdoor_size();
+
+// Hierarchical name of the memory that took the image, or NULL if none has.
+const char* mem_backdoor_target();
+
+// Register a host memory holding target addresses [base, base + size).
+// Returns its handle, or -1 if there is no image to load.
+int mem_backdoor_attach_host(const char* path, uint64_t base, uint64_t size);
+
+// At the host memory's first clock edge: if it is chosen to hold the image,
+// call page() for each page of it and return true.
+bool mem_backdoor_claim_host(int handle, void (*page)(uint64_t addr, const uint8_t* data, size_t len));
+
+#endif
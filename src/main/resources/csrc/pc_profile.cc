@@ -0,0 +1,280 @@
+// See LICENSE.SiFive for license details.
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "pc_profile.h"
+#include "sim_stats.h"
+
+struct symbol_t
+{
+  uint64_t addr;
+  uint64_t size;                // 0 if not known
+  std::string name;
+
+  bool operator<(const symbol_t& s) const { return addr < s.addr; }
+};
+
+static std::vector<symbol_t> symbols;   // sorted by address
+
+static uint64_t period = 0;
+static bool started = false;
+
+// The functions of each sample, outermost first, as indexes into symbols;
+// -1 for a PC outside them.
+typedef std::vector<int> stack_t;
+
+struct hart_t
+{
+  uint64_t pc;
+  std::vector<uint64_t> calls;  // innermost first
+  std::map<stack_t, uint64_t> stacks;
+  uint64_t samples;
+};
+
+static std::vector<hart_t> harts;
+
+static hart_t& hart(int hartid)
+{
+  if ((size_t)hartid >= harts.size())
+    harts.resize(hartid + 1, hart_t());
+  return harts[hartid];
+}
+
+void pc_profile_open(uint64_t p)
+{
+  period = p;
+}
+
+void pc_profile_start()
+{
+  started = period != 0;
+}
+
+// The functions of a symbol table, or if it has none (as in hand-written
+// assembly), its other symbols in code.
+template <class Ehdr, class Shdr, class Sym, int (*type)(unsigned char)>
+static void read_symbols(const char* base, size_t len, std::vector<symbol_t>& out)
+{
+  const Ehdr* eh = reinterpret_cast<const Ehdr*>(base);
+  if (eh->e_shoff == 0 || eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Shdr) > len)
+    return;
+  const Shdr* sh = reinterpret_cast<const Shdr*>(base + eh->e_shoff);
+  std::vector<symbol_t> funcs, labels;
+  for (unsigned i = 0; i < eh->e_shnum; i++) {
+    if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum)
+      continue;
+    const Shdr& strtab = sh[sh[i].sh_link];
+    if (sh[i].sh_offset + sh[i].sh_size > len ||
+        strtab.sh_offset + strtab.sh_size > len || strtab.sh_size == 0)
+      continue;
+    const Sym* sym = reinterpret_cast<const Sym*>(base + sh[i].sh_offset);
+    const char* names = base + strtab.sh_offset;
+    for (size_t j = 0; j < sh[i].sh_size / sizeof(Sym); j++) {
+      const Sym& s = sym[j];
+      if (s.st_shndx == SHN_UNDEF || s.st_shndx >= eh->e_shnum ||
+          s.st_name >= strtab.sh_size || !(sh[s.st_shndx].sh_flags & SHF_EXECINSTR))
+        continue;
+      const char* name = names + s.st_name;
+      if (!*name || strnlen(name, strtab.sh_size - s.st_name) == strtab.sh_size - s.st_name ||
+          name[0] == '$' || strncmp(name, ".L", 2) == 0)
+        continue;
+      int t = type(s.st_info);
+      if (t == STT_FUNC)
+        funcs.push_back(symbol_t{s.st_value, s.st_size, name});
+      else if (t == STT_NOTYPE)
+        labels.push_back(symbol_t{s.st_value, 0, name});
+    }
+  }
+  const std::vector<symbol_t>& use = funcs.empty() ? labels : funcs;
+  out.insert(out.end(), use.begin(), use.end());
+}
+
+static int elf32_type(unsigned char info) { return ELF32_ST_TYPE(info); }
+static int elf64_type(unsigned char info) { return ELF64_ST_TYPE(info); }
+
+bool pc_profile_add_symbols(const char* path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+    close(fd);
+    return false;
+  }
+  size_t len = st.st_size;
+  void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const char* base = static_cast<const char*>(map);
+  bool elf = memcmp(base, ELFMAG, SELFMAG) == 0 && base[EI_DATA] == ELFDATA2LSB;
+  std::vector<symbol_t> found;
+  if (elf && base[EI_CLASS] == ELFCLASS64)
+    read_symbols<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, elf64_type>(base, len, found);
+  else if (elf && base[EI_CLASS] == ELFCLASS32)
+    read_symbols<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, elf32_type>(base, len, found);
+  else
+    elf = false;
+  munmap(map, len);
+
+  symbols.insert(symbols.end(), found.begin(), found.end());
+  std::stable_sort(symbols.begin(), symbols.end());
+  // Of the names of one address, keep the first (a global, in the usual
+  // symbol table order of locals then globals, is as good as any).
+  symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                            [](const symbol_t& a, const symbol_t& b) { return a.addr == b.addr; }),
+                symbols.end());
+  return elf;
+}
+
+static int lookup(uint64_t pc)
+{
+  auto it = std::upper_bound(symbols.begin(), symbols.end(), symbol_t{pc, 0, ""});
+  if (it == symbols.begin())
+    return -1;
+  --it;
+  if (it->size && pc - it->addr >= it->size)
+    return -1;
+  return it - symbols.begin();
+}
+
+static const char* name(int symbol)
+{
+  return symbol < 0 ? "[unknown]" : symbols[symbol].name.c_str();
+}
+
+extern "C" int pc_sample_tick(int hartid, long long cycle)
+{
+  if (!started)
+    return 0;
+  return (uint64_t)cycle % period == 0 ? 2 : 1;
+}
+
+extern "C" void pc_sample(int hartid, long long pc, int depth)
+{
+  hart_t& h = hart(hartid);
+  h.pc = pc;
+  h.calls.clear();
+}
+
+extern "C" void pc_sample_frame(int hartid, long long call_pc)
+{
+  hart(hartid).calls.push_back(call_pc);
+}
+
+extern "C" void pc_sample_end(int hartid)
+{
+  sim_stats_timer_t timer(sim_stats_dpi_ns);
+  hart_t& h = hart(hartid);
+  // A call committed in the sampled cycle is both the PC and the innermost
+  // call.
+  size_t skip = !h.calls.empty() && h.calls[0] == h.pc;
+  stack_t stack;
+  stack.reserve(h.calls.size() + 1);
+  for (size_t i = h.calls.size(); i > skip; i--)
+    stack.push_back(lookup(h.calls[i - 1]));
+  stack.push_back(lookup(h.pc));
+  h.stacks[stack]++;
+  h.samples++;
+}
+
+static FILE* open_output(const char* filename)
+{
+  FILE* f = fopen(filename, "w");
+  if (!f)
+    fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+  return f;
+}
+
+static bool write_flat(const char* filename)
+{
+  FILE* f = open_output(filename);
+  if (!f)
+    return false;
+
+  uint64_t total = 0;
+  unsigned nharts = 0;
+  std::map<int, uint64_t> self, inclusive;
+  for (auto& h : harts) {
+    total += h.samples;
+    nharts += h.samples != 0;
+    for (auto& s : h.stacks) {
+      self[s.first.back()] += s.second;
+      std::set<int> seen(s.first.begin(), s.first.end());
+      for (int sym : seen)
+        inclusive[sym] += s.second;
+    }
+  }
+
+  std::vector<std::pair<uint64_t, int>> order;
+  for (auto& s : inclusive)
+    order.push_back(std::make_pair(self[s.first], s.first));
+  std::sort(order.begin(), order.end(),
+            [&](const std::pair<uint64_t, int>& a, const std::pair<uint64_t, int>& b) {
+              if (a.first != b.first)
+                return a.first > b.first;
+              return inclusive[a.second] > inclusive[b.second];
+            });
+
+  fprintf(f, "# %" PRIu64 " samples of %u hart%s, one every %" PRIu64 " cycles\n",
+          total, nharts, nharts == 1 ? "" : "s", period);
+  fprintf(f, "#  self%%  total%%  self samples  function\n");
+  double scale = total ? 100.0 / total : 0;
+  for (auto& o : order)
+    fprintf(f, "%7.2f %7.2f %13" PRIu64 "  %s\n", o.first * scale,
+            inclusive[o.second] * scale, o.first, name(o.second));
+  return fclose(f) == 0;
+}
+
+static bool write_folded(const char* filename)
+{
+  FILE* f = open_output(filename);
+  if (!f)
+    return false;
+
+  unsigned nharts = 0;
+  for (auto& h : harts)
+    nharts += h.samples != 0;
+  for (size_t i = 0; i < harts.size(); i++) {
+    for (auto& s : harts[i].stacks) {
+      if (nharts > 1)
+        fprintf(f, "hart%zu;", i);
+      for (size_t j = 0; j < s.first.size(); j++)
+        fprintf(f, "%s%s", j ? ";" : "", name(s.first[j]));
+      fprintf(f, " %" PRIu64 "\n", s.second);
+    }
+  }
+  return fclose(f) == 0;
+}
+
+bool pc_profile_write(const char* flat, const char* folded)
+{
+  bool sampled = false;
+  for (auto& h : harts)
+    sampled |= h.samples != 0;
+  if (!sampled)
+    fprintf(stderr, "--profile: no samples taken; the target did not start, "
+            "or ran for less than the interval\n");
+  bool ok = true;
+  if (flat)
+    ok &= write_flat(flat);
+  if (folded)
+    ok &= write_folded(folded);
+  return ok;
+}
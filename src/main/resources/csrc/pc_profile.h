@@ -0,0 +1,36 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef PC_PROFILE_H
+#define PC_PROFILE_H
+
+#include <stdint.h>
+
+// A statistical profile of the target program (--profile): every period
+// cycles, SimCoreMonitor hands over the PC each hart last committed and the
+// PCs of the calls it is in, and they are counted by function. The calls
+// are followed in the model as the core commits them, not found through
+// the frame pointer, so the stacks are whole whether or not the program
+// keeps one; a program that switches stacks (an OS) confuses them. Only
+// emulators built with PC_PROFILE=1 have the sampler.
+//
+// Functions are named from the symbol tables of the ELF files given to
+// pc_profile_add_symbols(); a PC outside all of them is "[unknown]".
+
+// Profile every period cycles once pc_profile_start() is called, which the
+// emulator does when the target starts, so that the debug module loading
+// the program is not in the profile.
+void pc_profile_open(uint64_t period);
+void pc_profile_start();
+
+// Name PCs from the functions of the ELF file path. Returns false if it is
+// not one.
+bool pc_profile_add_symbols(const char* path);
+
+// Write the flat profile (each function's share of the samples, in it and
+// in what it calls) to flat, and the stacks, one line per distinct stack
+// ("hart;caller;callee count", as flamegraph.pl and speedscope read them,
+// without the hart if there is only one) to folded; either may be NULL.
+// Returns false, having said why, if a file cannot be written.
+bool pc_profile_write(const char* flat, const char* folded);
+
+#endif
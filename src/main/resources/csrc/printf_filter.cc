@@ -0,0 +1,95 @@
+// See LICENSE.SiFive for license details.
+
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "printf_filter.h"
+
+bool printf_window = false;
+const uint8_t* printf_lines = NULL;
+
+static uint64_t window_start = 0;
+static uint64_t window_end = UINT64_MAX;
+static std::vector<uint8_t> lines;
+
+#ifdef VERILOG_MODULE_LINES
+// The line each module starts at, in order, then one past the last line.
+struct module_line_t
+{
+  int line;
+  const char* name;
+};
+
+static const module_line_t module_lines[] = VERILOG_MODULE_LINES;
+#endif
+
+bool printf_filter_modules(const char* patterns)
+{
+#ifndef VERILOG_MODULE_LINES
+  fprintf(stderr, "+verbose-modules needs an emulator built with the module line table\n");
+  return false;
+#else
+  std::vector<std::string> globs;
+  std::string s(patterns);
+  for (size_t pos = 0; pos <= s.size(); ) {
+    size_t comma = s.find(',', pos);
+    if (comma == std::string::npos)
+      comma = s.size();
+    if (comma > pos)
+      globs.push_back(s.substr(pos, comma - pos));
+    pos = comma + 1;
+  }
+
+  size_t modules = sizeof(module_lines) / sizeof(module_lines[0]) - 1;
+  lines.assign(module_lines[modules].line, 0);
+  std::vector<bool> used(globs.size(), false);
+  for (size_t i = 0; i < modules; i++) {
+    bool match = false;
+    for (size_t g = 0; g < globs.size(); g++) {
+      if (fnmatch(globs[g].c_str(), module_lines[i].name, 0) == 0)
+        match = used[g] = true;
+    }
+    if (match) {
+      for (int l = module_lines[i].line; l < module_lines[i + 1].line; l++)
+        lines[l] = 1;
+    }
+  }
+
+  for (size_t g = 0; g < globs.size(); g++) {
+    if (!used[g]) {
+      fprintf(stderr, "+verbose-modules: no module matches %s\n", globs[g].c_str());
+      return false;
+    }
+  }
+  printf_lines = lines.data();
+  return true;
+#endif
+}
+
+void printf_set_window(uint64_t start, uint64_t end)
+{
+  window_start = start;
+  window_end = end;
+}
+
+void printf_buffer(size_t bytes)
+{
+  if (!bytes)
+    return;
+  // Never freed: stdio flushes stderr at exit after the destructors run.
+  char* buf = static_cast<char*>(malloc(bytes));
+  if (buf)
+    setvbuf(stderr, buf, _IOFBF, bytes);
+}
+
+void printf_cycle(bool verbose, uint64_t cycle)
+{
+  bool open = verbose && cycle >= window_start && cycle < window_end;
+  if (printf_window && !open)
+    fflush(stderr);
+  printf_window = open;
+}
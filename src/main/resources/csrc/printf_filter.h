@@ -0,0 +1,38 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef PRINTF_FILTER_H
+#define PRINTF_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Narrowing down and buffering of the Chisel printfs that +verbose turns on.
+//
+// PRINTF_COND (see Makefrag-verilator) asks verbose_printf() (verilator.h)
+// with the line of the model's Verilog the printf is on. That is a test of
+// printf_window, which is only set between the cycles of +verbose-start and
+// +verbose-end, and, with +verbose-modules, a lookup in printf_lines, which
+// has a byte for each line of the Verilog that is set in the modules to
+// print from. The lines each module starts at come from the table the build
+// makes of the Verilog (VERILOG_MODULE_LINES).
+//
+// The printfs write to stderr, which is unbuffered; printf_buffer() gives it
+// a buffer, so that a line is no longer a write.
+
+extern bool printf_window;
+extern const uint8_t* printf_lines;
+
+// Print only from the modules whose names match one of the comma-separated
+// shell patterns. Returns false, having said why, if a pattern matches none.
+bool printf_filter_modules(const char* patterns);
+
+// Print only in cycles [start, end).
+void printf_set_window(uint64_t start, uint64_t end);
+
+// Buffer bytes of stderr; 0 leaves it unbuffered.
+void printf_buffer(size_t bytes);
+
+// Open or close the window for cycle, if verbose.
+void printf_cycle(bool verbose, uint64_t cycle);
+
+#endif
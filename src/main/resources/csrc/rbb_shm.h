@@ -0,0 +1,83 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef RBB_SHM_H
+#define RBB_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Layout of the shared memory file through which a client on the same host
+// can talk remote bitbang to the emulator (--rbb-shm) without a socket. The
+// byte stream is exactly what would go over the socket, commands in to_sim
+// and replies in from_sim, each a single-producer, single-consumer ring.
+//
+// The emulator creates the file with client set to RBB_SHM_FREE and both
+// rings empty. A client attaches by changing client from RBB_SHM_FREE to
+// RBB_SHM_ATTACHED with a compare-and-swap, and detaches by setting it to
+// RBB_SHM_DETACHING; the emulator then empties the rings and sets it back to
+// RBB_SHM_FREE. head and tail count all bytes ever written to and read from
+// a ring; only the producer writes head and only the consumer writes tail,
+// each after (release) the data it covers, and each reads the other's with
+// acquire semantics.
+
+#define RBB_SHM_MAGIC 0x53424252u   // "RBBS"
+#define RBB_SHM_VERSION 1
+#define RBB_SHM_RING_SIZE 65536     // a power of two
+
+enum {
+  RBB_SHM_FREE = 0,
+  RBB_SHM_ATTACHED = 1,
+  RBB_SHM_DETACHING = 2,
+};
+
+struct rbb_shm_ring_t
+{
+  uint64_t head;
+  char pad0[56];
+  uint64_t tail;
+  char pad1[56];
+  char data[RBB_SHM_RING_SIZE];
+};
+
+struct rbb_shm_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ring_size;
+  uint32_t client;
+  char pad[48];
+  rbb_shm_ring_t to_sim;
+  rbb_shm_ring_t from_sim;
+};
+
+// Copy up to len bytes out of ring; returns how many were copied.
+static inline size_t rbb_shm_read(rbb_shm_ring_t* ring, char* dst, size_t len)
+{
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = ring->tail;
+  size_t n = head - tail < len ? head - tail : len;
+  size_t offset = tail % RBB_SHM_RING_SIZE;
+  size_t first = n < RBB_SHM_RING_SIZE - offset ? n : RBB_SHM_RING_SIZE - offset;
+  memcpy(dst, ring->data + offset, first);
+  memcpy(dst + first, ring->data, n - first);
+  __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+// Copy up to len bytes into ring; returns how many fit.
+static inline size_t rbb_shm_write(rbb_shm_ring_t* ring, const char* src, size_t len)
+{
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  uint64_t head = ring->head;
+  size_t space = RBB_SHM_RING_SIZE - (head - tail);
+  size_t n = space < len ? space : len;
+  size_t offset = head % RBB_SHM_RING_SIZE;
+  size_t first = n < RBB_SHM_RING_SIZE - offset ? n : RBB_SHM_RING_SIZE - offset;
+  memcpy(ring->data + offset, src, first);
+  memcpy(ring->data, src + first, n - first);
+  __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+#endif
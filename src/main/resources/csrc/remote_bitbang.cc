@@ -3,8 +3,14 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -12,18 +18,51 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include "rbb_shm.h"
 #include "remote_bitbang.h"
 
 /////////// remote_bitbang_t
 
-remote_bitbang_t::remote_bitbang_t(uint16_t port) :
+// How many ticks to let pass between checks for a client when not waiting
+// for one; accepting a little late costs the client nothing noticeable.
+static const unsigned accept_interval = 1024;
+
+remote_bitbang_t::remote_bitbang_t(uint16_t port, const char* socket_path,
+                                   wait_policy_t wait, const char* shm_name) :
   socket_fd(0),
   client_fd(0),
+  socket_path(socket_path),
+  shm(NULL),
+  shm_attached(false),
+  wait_policy(wait),
+  connected_once(false),
+  waiting_reported(false),
+  accept_countdown(0),
   recv_start(0),
   recv_end(0),
+  recv_partial(false),
+  send_start(0),
+  send_end(0),
+  scan_bits(0),
+  scan_tick(0),
   err(0)
 {
-  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  tck = 1;
+  tms = 1;
+  tdi = 1;
+  trstn = 1;
+  quit = 0;
+
+  fprintf(stderr, "This emulator compiled with JTAG Remote Bitbang client. To enable, use +jtag_rbb_enable=1.\n");
+  if (shm_name)
+    create_shm(shm_name);
+  else
+    listen_socket(port);
+}
+
+void remote_bitbang_t::listen_socket(uint16_t port)
+{
+  socket_fd = socket(socket_path ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
   if (socket_fd == -1) {
     fprintf(stderr, "remote_bitbang failed to make socket: %s (%d)\n",
             strerror(errno), errno);
@@ -31,24 +70,43 @@ remote_bitbang_t::remote_bitbang_t(uint16_t port) :
   }
 
   fcntl(socket_fd, F_SETFL, O_NONBLOCK);
-  int reuseaddr = 1;
-  if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
-                 sizeof(int)) == -1) {
-    fprintf(stderr, "remote_bitbang failed setsockopt: %s (%d)\n",
-            strerror(errno), errno);
-    abort();
-  }
 
   struct sockaddr_in addr;
   memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = INADDR_ANY;
-  addr.sin_port = htons(port);
+  if (socket_path) {
+    struct sockaddr_un unix_addr;
+    memset(&unix_addr, 0, sizeof(unix_addr));
+    unix_addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(unix_addr.sun_path)) {
+      fprintf(stderr, "remote_bitbang socket path %s is too long\n", socket_path);
+      abort();
+    }
+    strcpy(unix_addr.sun_path, socket_path);
+    // A socket left behind by an earlier run would make bind() fail.
+    unlink(socket_path);
+    if (::bind(socket_fd, (struct sockaddr *) &unix_addr, sizeof(unix_addr)) == -1) {
+      fprintf(stderr, "remote_bitbang failed to bind socket %s: %s (%d)\n",
+              socket_path, strerror(errno), errno);
+      abort();
+    }
+  } else {
+    int reuseaddr = 1;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
+                   sizeof(int)) == -1) {
+      fprintf(stderr, "remote_bitbang failed setsockopt: %s (%d)\n",
+              strerror(errno), errno);
+      abort();
+    }
 
-  if (::bind(socket_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
-    fprintf(stderr, "remote_bitbang failed to bind socket: %s (%d)\n",
-            strerror(errno), errno);
-    abort();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (::bind(socket_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+      fprintf(stderr, "remote_bitbang failed to bind socket: %s (%d)\n",
+              strerror(errno), errno);
+      abort();
+    }
   }
 
   if (listen(socket_fd, 1) == -1) {
@@ -57,46 +115,122 @@ remote_bitbang_t::remote_bitbang_t(uint16_t port) :
     abort();
   }
 
-  socklen_t addrlen = sizeof(addr);
-  if (getsockname(socket_fd, (struct sockaddr *) &addr, &addrlen) == -1) {
-    fprintf(stderr, "remote_bitbang getsockname failed: %s (%d)\n",
-            strerror(errno), errno);
+  if (!socket_path) {
+    socklen_t addrlen = sizeof(addr);
+    if (getsockname(socket_fd, (struct sockaddr *) &addr, &addrlen) == -1) {
+      fprintf(stderr, "remote_bitbang getsockname failed: %s (%d)\n",
+              strerror(errno), errno);
+      abort();
+    }
+  }
+
+  if (socket_path)
+    fprintf(stderr, "Listening on %s\n", socket_path);
+  else
+    fprintf(stderr, "Listening on port %d\n",
+           ntohs(addr.sin_port));
+}
+
+void remote_bitbang_t::create_shm(const char* name)
+{
+  shm_path = std::string("/dev/shm/") + name;
+  int fd = open(shm_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1 || ftruncate(fd, sizeof(rbb_shm_t)) == -1) {
+    fprintf(stderr, "remote_bitbang failed to create %s: %s (%d)\n",
+            shm_path.c_str(), strerror(errno), errno);
+    abort();
+  }
+  void* p = mmap(NULL, sizeof(rbb_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "remote_bitbang failed to map %s: %s (%d)\n",
+            shm_path.c_str(), strerror(errno), errno);
     abort();
   }
 
-  tck = 1;
-  tms = 1;
-  tdi = 1;
-  trstn = 1;
-  quit = 0;
+  // The file is new and zero-filled, so the rings are empty; publish the
+  // header last.
+  shm = static_cast<rbb_shm_t*>(p);
+  shm->version = RBB_SHM_VERSION;
+  shm->ring_size = RBB_SHM_RING_SIZE;
+  __atomic_store_n(&shm->client, (uint32_t)RBB_SHM_FREE, __ATOMIC_RELEASE);
+  __atomic_store_n(&shm->magic, RBB_SHM_MAGIC, __ATOMIC_RELEASE);
 
-  fprintf(stderr, "This emulator compiled with JTAG Remote Bitbang client. To enable, use +jtag_rbb_enable=1.\n");
-  fprintf(stderr, "Listening on port %d\n",
-         ntohs(addr.sin_port));
+  fprintf(stderr, "Listening on %s\n", shm_path.c_str());
+}
+
+remote_bitbang_t::~remote_bitbang_t()
+{
+  if (shm) {
+    munmap(shm, sizeof(rbb_shm_t));
+    unlink(shm_path.c_str());
+    return;
+  }
+  if (client_fd > 0)
+    close(client_fd);
+  close(socket_fd);
+  if (socket_path)
+    unlink(socket_path);
 }
 
 void remote_bitbang_t::accept()
 {
+  bool wait = wait_policy == WAIT_ALWAYS ||
+              (wait_policy == WAIT_FIRST && !connected_once);
+  if (!wait && !shm && accept_countdown > 0) {
+    accept_countdown--;
+    return;
+  }
+  accept_countdown = accept_interval;
 
-  fprintf(stderr,"Attempting to accept client socket\n");
-  int again = 1;
-  while (again != 0) {
-    client_fd = ::accept(socket_fd, NULL, NULL);
-    if (client_fd == -1) {
-      if (errno == EAGAIN) {
-        // No client waiting to connect right now.
-      } else {
-        fprintf(stderr, "failed to accept on socket: %s (%d)\n", strerror(errno),
-                errno);
-        again = 0;
-        abort();
-      }
-    } else {
-      fcntl(client_fd, F_SETFL, O_NONBLOCK);
-      fprintf(stderr, "Accepted successfully.");
-      again = 0;
-    }
+  if (wait && !waiting_reported) {
+    fprintf(stderr, "Waiting for a remote bitbang client to connect\n");
+    waiting_reported = true;
+  }
+
+  if (shm) {
+    if (!accept_shm(wait))
+      return;
+    fprintf(stderr, "Accepted successfully.\n");
+    connected_once = true;
+    waiting_reported = false;
+    return;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = socket_fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if (poll(&pfd, 1, wait ? -1 : 0) == -1) {
+    if (errno == EINTR)
+      return;
+    fprintf(stderr, "remote_bitbang failed to poll socket: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
   }
+  if (!(pfd.revents & POLLIN))
+    return;
+
+  client_fd = ::accept(socket_fd, NULL, NULL);
+  if (client_fd == -1) {
+    client_fd = 0;
+    // The client may have given up between poll() and accept().
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)
+      return;
+    fprintf(stderr, "failed to accept on socket: %s (%d)\n", strerror(errno),
+            errno);
+    abort();
+  }
+
+  fcntl(client_fd, F_SETFL, O_NONBLOCK);
+  if (!socket_path) {
+    // Replies are small and the client waits for them.
+    int nodelay = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  }
+  fprintf(stderr, "Accepted successfully.\n");
+  connected_once = true;
+  waiting_reported = false;
 }
 
 void remote_bitbang_t::tick(
@@ -107,7 +241,7 @@ void remote_bitbang_t::tick(
                             unsigned char jtag_tdo
                             )
 {
-  if (client_fd > 0) {
+  if (connected()) {
     tdo = jtag_tdo;
     execute_command();
   } else {
@@ -121,6 +255,30 @@ void remote_bitbang_t::tick(
 
 }
 
+remote_bitbang_t::snapshot_t remote_bitbang_t::snapshot()
+{
+  snapshot_t s;
+  s.tck = tck;
+  s.tms = tms;
+  s.tdi = tdi;
+  s.trstn = trstn;
+  s.tdo = tdo;
+  s.quit = quit;
+  s.err = err;
+  return s;
+}
+
+void remote_bitbang_t::restore(const snapshot_t& s)
+{
+  tck = s.tck;
+  tms = s.tms;
+  tdi = s.tdi;
+  trstn = s.trstn;
+  tdo = s.tdo;
+  quit = s.quit;
+  err = s.err;
+}
+
 void remote_bitbang_t::reset(){
   //trstn = 0;
 }
@@ -131,72 +289,228 @@ void remote_bitbang_t::set_pins(char _tck, char _tms, char _tdi){
   tdi = _tdi;
 }
 
+// Checking the client field is a single load, so unlike a socket, shared
+// memory is looked at on every tick.
+bool remote_bitbang_t::accept_shm(bool wait)
+{
+  while (__atomic_load_n(&shm->client, __ATOMIC_ACQUIRE) != RBB_SHM_ATTACHED) {
+    if (!wait)
+      return false;
+    usleep(1000);
+  }
+  shm_attached = true;
+  return true;
+}
+
+bool remote_bitbang_t::fill_recv_buf()
+{
+  memmove(recv_buf, recv_buf + recv_start, recv_end - recv_start);
+  recv_end -= recv_start;
+  recv_start = 0;
+  if (shm) {
+    // Whatever a detaching client wrote before it let go is still taken.
+    uint32_t client = __atomic_load_n(&shm->client, __ATOMIC_ACQUIRE);
+    size_t n = rbb_shm_read(&shm->to_sim, recv_buf + recv_end, buf_size - recv_end);
+    if (n == 0)
+      return client == RBB_SHM_ATTACHED;
+    recv_end += n;
+    recv_partial = false;
+    return true;
+  }
+  ssize_t num_read = read(client_fd, recv_buf + recv_end, buf_size - recv_end);
+  if (num_read == -1) {
+    if (errno == EAGAIN || errno == EINTR)
+      return true;
+    fprintf(stderr, "remote_bitbang failed to read on socket: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
+  }
+  if (num_read == 0)
+    return false;
+  recv_end += num_read;
+  recv_partial = false;
+  return true;
+}
+
+void remote_bitbang_t::flush_send_buf()
+{
+  while (send_start < send_end) {
+    if (shm) {
+      size_t bytes = rbb_shm_write(&shm->from_sim, send_buf + send_start, send_end - send_start);
+      // A full ring is left for the next tick too.
+      if (bytes == 0)
+        return;
+      send_start += bytes;
+      continue;
+    }
+    ssize_t bytes = write(client_fd, send_buf + send_start, send_end - send_start);
+    if (bytes == -1) {
+      // The client is not keeping up; try again on the next tick.
+      if (errno == EAGAIN || errno == EINTR)
+        return;
+      fprintf(stderr, "failed to write to socket: %s (%d)\n", strerror(errno), errno);
+      abort();
+    }
+    send_start += bytes;
+  }
+  send_start = send_end = 0;
+}
+
+bool remote_bitbang_t::reserve_send(ssize_t n)
+{
+  if (send_end + n <= buf_size)
+    return true;
+  flush_send_buf();
+  memmove(send_buf, send_buf + send_start, send_end - send_start);
+  send_end -= send_start;
+  send_start = 0;
+  return send_end + n <= buf_size;
+}
+
+bool remote_bitbang_t::start_scan()
+{
+  ssize_t avail = recv_end - recv_start;
+  if (avail < 4) {
+    recv_partial = true;
+    return false;
+  }
+  const unsigned char* args = (const unsigned char*) recv_buf + recv_start;
+  uint32_t bits = args[0] | args[1] << 8 | args[2] << 16 | (uint32_t)args[3] << 24;
+  if (bits == 0 || bits > scan_max_bits) {
+    fprintf(stderr, "remote_bitbang got a scan of %u bits; at most %u are supported\n",
+            bits, scan_max_bits);
+    abort();
+  }
+  ssize_t bytes = (bits + 7) / 8;
+  if (avail < 4 + 2 * bytes) {
+    recv_partial = true;
+    return false;
+  }
+  if (!reserve_send(bytes))
+    return false;
+
+  memcpy(scan_tms, args + 4, bytes);
+  memcpy(scan_tdi, args + 4 + bytes, bytes);
+  memset(scan_tdo, 0, bytes);
+  recv_start += 4 + 2 * bytes;
+  scan_bits = bits;
+  scan_tick = 0;
+  return true;
+}
+
+void remote_bitbang_t::scan_step()
+{
+  uint32_t bit = scan_tick / 2;
+  unsigned char mask = 1 << (bit % 8);
+  char bit_tms = (scan_tms[bit / 8] & mask) != 0;
+  char bit_tdi = (scan_tdi[bit / 8] & mask) != 0;
+  if (scan_tick % 2 == 0) {
+    set_pins(0, bit_tms, bit_tdi);
+  } else {
+    // tdo is what the model drove after the falling edge.
+    if (tdo)
+      scan_tdo[bit / 8] |= mask;
+    set_pins(1, bit_tms, bit_tdi);
+  }
+
+  if (++scan_tick == 2 * scan_bits) {
+    // start_scan() made room for this.
+    ssize_t bytes = (scan_bits + 7) / 8;
+    memcpy(send_buf + send_end, scan_tdo, bytes);
+    send_end += bytes;
+    scan_bits = scan_tick = 0;
+    if (recv_start == recv_end)
+      flush_send_buf();
+  }
+}
+
+void remote_bitbang_t::disconnect()
+{
+  if (shm) {
+    // The client is gone, or going, and no longer touches the rings.
+    shm->to_sim.head = shm->to_sim.tail = 0;
+    shm->from_sim.head = shm->from_sim.tail = 0;
+    __atomic_store_n(&shm->client, (uint32_t)RBB_SHM_FREE, __ATOMIC_RELEASE);
+    shm_attached = false;
+  } else {
+    close(client_fd);
+  }
+  client_fd = 0;
+  recv_start = recv_end = 0;
+  recv_partial = false;
+  send_start = send_end = 0;
+  scan_bits = scan_tick = 0;
+  accept_countdown = 0;
+}
+
 void remote_bitbang_t::execute_command()
 {
-  char command;
-  int again = 1;
-  while (again) {
-    ssize_t num_read = read(client_fd, &command, sizeof(command));
-    if (num_read == -1) {
-      if (errno == EAGAIN) {
-        // We'll try again the next call.
-        //fprintf(stderr, "Received no command. Will try again on the next call\n");
-      } else {
-        fprintf(stderr, "remote_bitbang failed to read on socket: %s (%d)\n",
-                strerror(errno), errno);
-        again = 0;
-        abort();
-      }
-    } else if (num_read == 0) {
-      fprintf(stderr, "No Command Received.\n");
-      again = 1;
-    } else {
-      again = 0;
+  if (scan_tick < 2 * scan_bits) {
+    scan_step();
+    return;
+  }
+
+  // The client waits for the replies to a batch before it sends the next
+  // one, so only ask for more once the last batch has been answered.
+  if (recv_start == recv_end || recv_partial) {
+    flush_send_buf();
+    if (send_start < send_end)
+      return;
+    if (!fill_recv_buf()) {
+      fprintf(stderr, "Remote end disconnected\n");
+      disconnect();
+      return;
     }
   }
 
-  //fprintf(stderr, "Received a command %c\n", command);
-
-  int dosend = 0;
-
-  char tosend = '?';
-
-  switch (command) {
-  case 'B': /* fprintf(stderr, "*BLINK*\n"); */ break;
-  case 'b': /* fprintf(stderr, "_______\n"); */ break;
-  case 'r': reset(); break; // This is wrong. 'r' has other bits that indicated TRST and SRST.
-  case '0': set_pins(0, 0, 0); break;
-  case '1': set_pins(0, 0, 1); break;
-  case '2': set_pins(0, 1, 0); break;
-  case '3': set_pins(0, 1, 1); break;
-  case '4': set_pins(1, 0, 0); break;
-  case '5': set_pins(1, 0, 1); break;
-  case '6': set_pins(1, 1, 0); break;
-  case '7': set_pins(1, 1, 1); break;
-  case 'R': dosend = 1; tosend = tdo ? '1' : '0'; break;
-  case 'Q': quit = 1; break;
-  default:
-    fprintf(stderr, "remote_bitbang got unsupported command '%c'\n",
-            command);
-  }
-
-  if (dosend){
-    while (1) {
-      ssize_t bytes = write(client_fd, &tosend, sizeof(tosend));
-      if (bytes == -1) {
-        fprintf(stderr, "failed to write to socket: %s (%d)\n", strerror(errno), errno);
-        abort();
+  bool pins_changed = false;
+  bool stalled = false;
+  while (recv_start < recv_end && !pins_changed && !stalled && !quit) {
+    char command = recv_buf[recv_start++];
+
+    switch (command) {
+    case 'B': /* fprintf(stderr, "*BLINK*\n"); */ break;
+    case 'b': /* fprintf(stderr, "_______\n"); */ break;
+    case 'r': reset(); break; // This is wrong. 'r' has other bits that indicated TRST and SRST.
+    case '0': set_pins(0, 0, 0); pins_changed = true; break;
+    case '1': set_pins(0, 0, 1); pins_changed = true; break;
+    case '2': set_pins(0, 1, 0); pins_changed = true; break;
+    case '3': set_pins(0, 1, 1); pins_changed = true; break;
+    case '4': set_pins(1, 0, 0); pins_changed = true; break;
+    case '5': set_pins(1, 0, 1); pins_changed = true; break;
+    case '6': set_pins(1, 1, 0); pins_changed = true; break;
+    case '7': set_pins(1, 1, 1); pins_changed = true; break;
+    case 'R':
+    case 'V':
+      if (!reserve_send(1)) {
+        // Still no room; hold the command until there is.
+        recv_start--;
+        return;
       }
-      if (bytes > 0) {
+      send_buf[send_end++] = command == 'V' ? 'V' : tdo ? '1' : '0';
+      break;
+    case 'S':
+      if (!start_scan()) {
+        recv_start--;
+        stalled = true;
         break;
       }
+      scan_step();
+      pins_changed = true;
+      break;
+    case 'Q': quit = 1; break;
+    default:
+      fprintf(stderr, "remote_bitbang got unsupported command '%c'\n",
+              command);
     }
   }
 
+  if (recv_start == recv_end || recv_partial || quit)
+    flush_send_buf();
+
   if (quit) {
     // The remote disconnected.
     fprintf(stderr, "Remote end disconnected\n");
-    close(client_fd);
-    client_fd = 0;
+    disconnect();
   }
 }
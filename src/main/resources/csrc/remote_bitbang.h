@@ -3,15 +3,47 @@
 #ifndef REMOTE_BITBANG_H
 #define REMOTE_BITBANG_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <string>
+
+struct rbb_shm_t;
+
+// Besides the remote bitbang commands OpenOCD sends, the server takes a
+// vector scan, so that a client can shift a whole IR or DR scan with one
+// message instead of three characters per bit:
+//
+//   'V'                  Answered with 'V'. A client sends "VR" and looks at
+//                        the first byte of the reply: a plain bitbang server
+//                        only answers the 'R', with '0' or '1'.
+//   'S' N TMS TDI        N is a 32-bit little-endian count of TCK cycles, at
+//                        most scan_max_bits, and TMS and TDI are (N + 7) / 8
+//                        bytes each, least significant bit first. For each
+//                        bit the server drives TCK low with that bit's TMS
+//                        and TDI, samples TDO, then drives TCK high, as
+//                        OpenOCD's bitbang driver does. It answers with the
+//                        (N + 7) / 8 bytes of sampled TDO.
 class remote_bitbang_t
 {
 public:
-  // Create a new server, listening for connections from localhost on the given
-  // port.
-  remote_bitbang_t(uint16_t port);
+  // When to stop the simulation until a client connects: never, only until
+  // the first client has connected, or whenever no client is connected.
+  // Otherwise the simulation keeps running and picks up a client, including
+  // one reconnecting, when it arrives.
+  enum wait_policy_t { WAIT_NEVER, WAIT_FIRST, WAIT_ALWAYS };
+
+  // Longest 'S' scan, in TCK cycles.
+  static const uint32_t scan_max_bits = 8 * 4096;
+
+  // Create a new server, listening for connections on the Unix-domain socket
+  // socket_path if it is given, and otherwise from localhost on the given
+  // port. If shm_name is given, there is no socket; instead a client
+  // attaches to the shared memory file /dev/shm/shm_name (see rbb_shm.h).
+  remote_bitbang_t(uint16_t port, const char* socket_path = NULL,
+                   wait_policy_t wait = WAIT_FIRST, const char* shm_name = NULL);
+  ~remote_bitbang_t();
 
   // Do a bit of work.
   void tick(unsigned char * jtag_tck,
@@ -23,6 +55,22 @@ public:
   unsigned char done() {return quit;}
   
   int exit_code() {return err;}
+
+  // Pin and exit state, saved and restored along with the model by the
+  // emulator's checkpoints. A connected client is not part of it; it has to
+  // reconnect after a restore.
+  struct snapshot_t {
+    unsigned char tck;
+    unsigned char tms;
+    unsigned char tdi;
+    unsigned char trstn;
+    unsigned char tdo;
+    unsigned char quit;
+    int err;
+  };
+
+  snapshot_t snapshot();
+  void restore(const snapshot_t& s);
   
  private:
 
@@ -37,17 +85,62 @@ public:
     
   int socket_fd;
   int client_fd;
+  const char* socket_path;
+  std::string shm_path;
+  rbb_shm_t* shm;
+  bool shm_attached;
+  wait_policy_t wait_policy;
+  bool connected_once;
+  bool waiting_reported;
+  // Ticks until the next check for a client when not waiting for one.
+  unsigned accept_countdown;
 
+  // Commands read from the client but not yet executed, and replies not
+  // yet written back. Both are drained in order. recv_partial is set when
+  // what is left of recv_buf is the start of a command.
   static const ssize_t buf_size = 64 * 1024;
   char recv_buf[buf_size];
   ssize_t recv_start, recv_end;
+  bool recv_partial;
+  char send_buf[buf_size];
+  ssize_t send_start, send_end;
+
+  // The 'S' scan being clocked: scan_bits TCK cycles of two ticks each,
+  // of which scan_tick have been done.
+  unsigned char scan_tms[scan_max_bits / 8];
+  unsigned char scan_tdi[scan_max_bits / 8];
+  unsigned char scan_tdo[scan_max_bits / 8];
+  uint32_t scan_bits;
+  uint32_t scan_tick;
+
+  void listen_socket(uint16_t port);
+  void create_shm(const char* name);
+  bool connected() { return shm ? shm_attached : client_fd > 0; }
 
-  // Check for a client connecting, and accept if there is one.
+  // Check for a client connecting, and accept if there is one. Waits in
+  // poll() for one if the wait policy says to.
   void accept();
-  // Execute any commands the client has for us.
-  // But we only execute 1 because we need time for the
-  // simulation to run.
+  bool accept_shm(bool wait);
+  // Execute the client's commands up to and including the next one that
+  // changes the pins, since the model needs a tick to respond to it.
+  // Commands that only read TDO or do nothing are handled in the same tick,
+  // so a whole batch from the client costs one read() and its 'R' replies
+  // one write().
   void execute_command();
+  // Read as many commands as the client has sent, without waiting. Returns
+  // false if the client has disconnected.
+  bool fill_recv_buf();
+  // Write out as much of send_buf as the socket will take.
+  void flush_send_buf();
+  // Make room for n more bytes in send_buf, if the socket lets us.
+  bool reserve_send(ssize_t n);
+  // Take an 'S' command's arguments from recv_buf and start clocking it.
+  // Returns false if they have not all arrived, or there is no room for
+  // the reply yet.
+  bool start_scan();
+  // Do one tick of the current scan.
+  void scan_step();
+  void disconnect();
 
   // Reset. Currently does nothing.
   void reset();
@@ -0,0 +1,192 @@
+// See LICENSE.SiFive for license details.
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "sim_stats.h"
+#include "SimCoreMonitor.h"
+
+typedef std::chrono::steady_clock sim_clock_t;
+
+bool sim_stats_enabled = false;
+uint64_t sim_stats_eval_ns = 0;
+uint64_t sim_stats_dpi_ns = 0;
+
+static const char* phase_names[SIM_NPHASES] = {
+  "construction", "reset", "load", "run"
+};
+
+static sim_phase_t phase = SIM_PHASE_CONSTRUCTION;
+static sim_clock_t::time_point start_time;
+static sim_clock_t::time_point phase_start;
+static uint64_t phase_start_cycle = 0;
+static double phase_seconds[SIM_NPHASES];
+static uint64_t phase_cycles[SIM_NPHASES];
+
+static uint64_t progress_cycles = 0;
+static double progress_seconds = 0;
+static uint64_t next_progress_cycle = 0;
+static sim_clock_t::time_point next_progress_time;
+
+// State at the previous progress line, which each line is relative to.
+static sim_clock_t::time_point last_time;
+static uint64_t last_cycle = 0;
+static uint64_t last_instret = 0;
+static uint64_t last_eval_ns = 0;
+static uint64_t last_dpi_ns = 0;
+
+static double seconds_between(sim_clock_t::time_point from, sim_clock_t::time_point to)
+{
+  return std::chrono::duration<double>(to - from).count();
+}
+
+static uint64_t current_rss()
+{
+  unsigned long long size, resident;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  int n = fscanf(f, "%llu %llu", &size, &resident);
+  fclose(f);
+  return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+static uint64_t peak_rss()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+static double cpu_seconds()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+void sim_stats_start(bool enable, uint64_t cycles, double seconds)
+{
+  start_time = phase_start = last_time = sim_clock_t::now();
+  sim_stats_enabled = enable;
+  progress_cycles = cycles;
+  progress_seconds = seconds;
+  next_progress_time = start_time + std::chrono::duration_cast<sim_clock_t::duration>(
+    std::chrono::duration<double>(seconds));
+}
+
+static void end_phase(sim_clock_t::time_point now, uint64_t cycle)
+{
+  phase_seconds[phase] += seconds_between(phase_start, now);
+  phase_cycles[phase] += cycle - phase_start_cycle;
+  phase_start = now;
+  phase_start_cycle = cycle;
+}
+
+void sim_stats_phase(sim_phase_t next, uint64_t cycle)
+{
+  sim_clock_t::time_point now = sim_clock_t::now();
+  end_phase(now, cycle);
+  // Progress is about simulating, so it starts once the model is built.
+  if (phase == SIM_PHASE_CONSTRUCTION) {
+    last_time = now;
+    last_cycle = cycle;
+    next_progress_cycle = cycle + progress_cycles;
+  }
+  phase = next;
+}
+
+void sim_stats_restored(uint64_t cycle)
+{
+  phase_start_cycle = last_cycle = cycle;
+  next_progress_cycle = cycle + progress_cycles;
+}
+
+static void print_progress(sim_clock_t::time_point now, uint64_t cycle)
+{
+  double seconds = seconds_between(last_time, now);
+  uint64_t instret = core_monitor_instret();
+  double eval = (sim_stats_eval_ns - last_eval_ns) * 1e-9;
+  double dpi = (sim_stats_dpi_ns - last_dpi_ns) * 1e-9;
+  double pct = seconds > 0 ? 100 / seconds : 0;
+
+  fprintf(stderr, "[stats] cycle %llu: %.2f kHz, model %.1f%%, DPI %.1f%%, "
+          "instret %llu (+%llu), rss %.1f MiB\n",
+          (unsigned long long)cycle,
+          seconds > 0 ? (cycle - last_cycle) / seconds / 1e3 : 0.0,
+          (eval - dpi) * pct, dpi * pct,
+          (unsigned long long)instret, (unsigned long long)(instret - last_instret),
+          current_rss() / 1048576.0);
+
+  last_time = now;
+  last_cycle = cycle;
+  last_instret = instret;
+  last_eval_ns = sim_stats_eval_ns;
+  last_dpi_ns = sim_stats_dpi_ns;
+}
+
+void sim_stats_cycle(uint64_t cycle)
+{
+  bool due = progress_cycles && cycle >= next_progress_cycle;
+  // Reading the clock every cycle would show up in the model time.
+  if (progress_seconds > 0 && (cycle & 0xff) == 0 &&
+      sim_clock_t::now() >= next_progress_time)
+    due = true;
+  if (!due)
+    return;
+
+  sim_clock_t::time_point now = sim_clock_t::now();
+  print_progress(now, cycle);
+  if (progress_cycles)
+    next_progress_cycle = cycle + progress_cycles;
+  if (progress_seconds > 0)
+    next_progress_time = now + std::chrono::duration_cast<sim_clock_t::duration>(
+      std::chrono::duration<double>(progress_seconds));
+}
+
+bool sim_stats_write_json(const char* filename, unsigned seed, uint64_t cycle,
+                          int exit_code)
+{
+  sim_clock_t::time_point now = sim_clock_t::now();
+  end_phase(now, cycle);
+
+  FILE* f = fopen(filename, "w");
+  if (!f) {
+    fprintf(stderr, "Unable to open %s for stats write\n", filename);
+    return false;
+  }
+
+  // Throughput counts only the cycles simulated by this process, which
+  // excludes those restored from a checkpoint.
+  uint64_t simulated = 0;
+  double sim_seconds = 0;
+  for (int i = SIM_PHASE_RESET; i < SIM_NPHASES; i++) {
+    simulated += phase_cycles[i];
+    sim_seconds += phase_seconds[i];
+  }
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"seed\": %u,\n", seed);
+  fprintf(f, "  \"exit_code\": %d,\n", exit_code);
+  fprintf(f, "  \"cycles\": %llu,\n", (unsigned long long)cycle);
+  fprintf(f, "  \"instret\": %llu,\n", (unsigned long long)core_monitor_instret());
+  fprintf(f, "  \"wall_seconds\": %.6f,\n", seconds_between(start_time, now));
+  fprintf(f, "  \"cpu_seconds\": %.6f,\n", cpu_seconds());
+  fprintf(f, "  \"khz\": %.3f,\n", sim_seconds > 0 ? simulated / sim_seconds / 1e3 : 0.0);
+  fprintf(f, "  \"eval_seconds\": %.6f,\n", sim_stats_eval_ns * 1e-9);
+  fprintf(f, "  \"dpi_seconds\": %.6f,\n", sim_stats_dpi_ns * 1e-9);
+  fprintf(f, "  \"peak_rss_bytes\": %llu,\n", (unsigned long long)peak_rss());
+  fprintf(f, "  \"phases\": {\n");
+  for (int i = 0; i < SIM_NPHASES; i++)
+    fprintf(f, "    \"%s\": { \"seconds\": %.6f, \"cycles\": %llu }%s\n",
+            phase_names[i], phase_seconds[i], (unsigned long long)phase_cycles[i],
+            i + 1 < SIM_NPHASES ? "," : "");
+  fprintf(f, "  }\n");
+  fprintf(f, "}\n");
+  fclose(f);
+  return true;
+}
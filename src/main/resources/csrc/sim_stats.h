@@ -0,0 +1,69 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef SIM_STATS_H
+#define SIM_STATS_H
+
+#include <chrono>
+#include <stdint.h>
+
+// Where the emulator's wall-clock time goes. A run moves through the phases
+// in order, except that --fast-load loads the program before reset.
+enum sim_phase_t {
+  SIM_PHASE_CONSTRUCTION, // building the model and the host side
+  SIM_PHASE_RESET,        // holding the model in reset, or restoring it
+  SIM_PHASE_LOAD,         // fesvr loading the program
+  SIM_PHASE_RUN,          // the target running the program
+  SIM_NPHASES
+};
+
+// Set by sim_stats_start(); the timers below do nothing until then, so a
+// run that asks for no statistics pays for no clock reads.
+extern bool sim_stats_enabled;
+
+// Nanoseconds spent in TEST_HARNESS::eval() and, within that, in host-side
+// DPI calls (debug_tick, jtag_tick).
+extern uint64_t sim_stats_eval_ns;
+extern uint64_t sim_stats_dpi_ns;
+
+// Adds the lifetime of the object to a nanosecond counter.
+class sim_stats_timer_t
+{
+ public:
+  sim_stats_timer_t(uint64_t& total) : total(total)
+  {
+    if (sim_stats_enabled)
+      start = std::chrono::steady_clock::now();
+  }
+
+  ~sim_stats_timer_t()
+  {
+    if (sim_stats_enabled)
+      total += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+ private:
+  uint64_t& total;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Start timing the phases. If enable is set, also start the eval and DPI
+// timers, and print a progress line to stderr every progress_cycles cycles
+// and every progress_seconds seconds (either may be 0 for never).
+void sim_stats_start(bool enable, uint64_t progress_cycles, double progress_seconds);
+
+// Enter a phase at the given cycle.
+void sim_stats_phase(sim_phase_t phase, uint64_t cycle);
+
+// The model jumped to cycle by restoring a checkpoint; those cycles were not
+// simulated by this run.
+void sim_stats_restored(uint64_t cycle);
+
+// Called once a cycle when sim_stats_enabled; prints progress when due.
+void sim_stats_cycle(uint64_t cycle);
+
+// End the current phase and write a JSON summary of the run to filename.
+bool sim_stats_write_json(const char* filename, unsigned seed, uint64_t cycle,
+                          int exit_code);
+
+#endif
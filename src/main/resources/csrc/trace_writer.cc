@@ -0,0 +1,135 @@
+// See LICENSE.SiFive for license details.
+
+#include <string.h>
+
+#include "trace_writer.h"
+
+trace_writer_t::trace_writer_t()
+  : file(NULL), gz(NULL), is_open(false), failed(false), current(NULL),
+    closing(false)
+{
+}
+
+trace_writer_t::~trace_writer_t()
+{
+  close();
+}
+
+static bool ends_with(const std::string& s, const char* suffix)
+{
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool trace_writer_t::open(const std::string& filename)
+{
+  if (is_open)
+    return true;
+
+  name = filename;
+  if (name == "-")
+    file = stdout;
+  else if (ends_with(name, ".gz"))
+    // Favor speed; a trace compresses well even at the lowest level.
+    gz = gzopen(name.c_str(), "wb1");
+  else
+    file = fopen(name.c_str(), "w");
+  if (!file && !gz)
+    return false;
+
+  failed = false;
+  closing = false;
+  full.clear();
+  empty.clear();
+  for (int i = 0; i < nbuffers; i++) {
+    buffers[i].clear();
+    buffers[i].reserve(buffer_size);
+    empty.push_back(&buffers[i]);
+  }
+  current = empty.front();
+  empty.pop_front();
+
+  writer = std::thread(&trace_writer_t::run, this);
+  is_open = true;
+  return true;
+}
+
+void trace_writer_t::close()
+{
+  if (!is_open)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!current->empty())
+      full.push_back(current);
+    current = NULL;
+    closing = true;
+  }
+  cond.notify_all();
+  writer.join();
+
+  if (gz)
+    gzclose(gz);
+  else if (file == stdout)
+    fflush(file);
+  else
+    fclose(file);
+  gz = NULL;
+  file = NULL;
+  is_open = false;
+}
+
+ssize_t trace_writer_t::write(const char* bufp, ssize_t len)
+{
+  ssize_t left = len;
+  while (left > 0) {
+    size_t n = std::min((size_t)left, buffer_size - current->size());
+    current->insert(current->end(), bufp, bufp + n);
+    bufp += n;
+    left -= n;
+    if (current->size() == buffer_size)
+      submit();
+  }
+  return len;
+}
+
+void trace_writer_t::submit()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  full.push_back(current);
+  cond.notify_all();
+  cond.wait(lock, [this] { return !empty.empty(); });
+  current = empty.front();
+  empty.pop_front();
+}
+
+bool trace_writer_t::write_out(const buffer_t& buf)
+{
+  if (gz)
+    return gzwrite(gz, buf.data(), buf.size()) == (int)buf.size();
+  return fwrite(buf.data(), 1, buf.size(), file) == buf.size();
+}
+
+void trace_writer_t::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cond.wait(lock, [this] { return !full.empty() || closing; });
+    if (full.empty())
+      break;
+    buffer_t* buf = full.front();
+    full.pop_front();
+
+    lock.unlock();
+    if (!failed && !write_out(*buf)) {
+      fprintf(stderr, "Unable to write trace to %s\n", name.c_str());
+      failed = true;
+    }
+    buf->clear();
+    lock.lock();
+
+    empty.push_back(buf);
+    cond.notify_all();
+  }
+}
@@ -0,0 +1,58 @@
+// See LICENSE.SiFive for license details.
+
+#ifndef TRACE_WRITER_H
+#define TRACE_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <zlib.h>
+
+#include "verilated_vcd_c.h"
+
+// Output file for VerilatedVcdC that keeps disk I/O and compression off the
+// simulation thread. Trace text is copied into one of a few large buffers;
+// a full buffer is handed to a writer thread while the simulation carries on
+// filling the next, and only waits if the writer falls behind by all of
+// them. A name ending in ".gz" is written gzip-compressed, "-" is stdout.
+class trace_writer_t : public VerilatedVcdFile
+{
+ public:
+  trace_writer_t();
+  ~trace_writer_t();
+
+  bool open(const std::string& name) override;
+  void close() override;
+  ssize_t write(const char* bufp, ssize_t len) override;
+
+ private:
+  typedef std::vector<char> buffer_t;
+
+  static const size_t buffer_size = 4 << 20;
+  static const int nbuffers = 3;
+
+  void submit();
+  void run();
+  bool write_out(const buffer_t& buf);
+
+  std::string name;
+  FILE* file;
+  gzFile gz;
+  bool is_open;
+  bool failed;
+
+  buffer_t buffers[nbuffers];
+  buffer_t* current;
+  std::deque<buffer_t*> full;
+  std::deque<buffer_t*> empty;
+  bool closing;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::thread writer;
+};
+
+#endif
@@ -4,26 +4,18 @@
 #include "verilated_vcd_c.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 extern bool verbose;
 extern bool done_reset;
+extern bool printf_window;
+extern const uint8_t* printf_lines;
 
-class VerilatedVcdFILE : public VerilatedVcdFile {
- public:
-  VerilatedVcdFILE(FILE* file) : file(file) {}
-  ~VerilatedVcdFILE() {}
-  bool open(const std::string& name) override {
-    // file should already be open
-    return file != NULL;
-  }
-  void close() override {
-    // file should be closed elsewhere
-  }
-  ssize_t write(const char* bufp, ssize_t len) override {
-    return fwrite(bufp, 1, len, file);
-  }
- private:
-  FILE* file;
-};
+// PRINTF_COND: is the Chisel printf on this line of the model's Verilog to
+// print? (see printf_filter.h)
+static inline bool verbose_printf(int line)
+{
+  return printf_window && done_reset && (!printf_lines || printf_lines[line]);
+}
 
 #endif
@@ -0,0 +1,73 @@
+// See LICENSE.SiFive for license details.
+//VCS coverage exclude_file
+
+// Hands the commit log of a core to the host in binary (see
+// csrc/SimCommitLog.cc and csrc/commit_log.h), alongside the printfs. Only
+// the emulator, which defines COMMIT_LOG, links the C side; everywhere else
+// this module is empty.
+
+`ifdef COMMIT_LOG
+import "DPI-C" function void commit_log_commit
+(
+  input int      widths,
+  input int      hartid,
+  input int      priv,
+  input longint  pc,
+  input int      insn,
+  input int      has_rd,
+  input int      fp,
+  input int      partial,
+  input int      rd,
+  input int      pdst,
+  input longint  data
+);
+
+import "DPI-C" function void commit_log_writeback
+(
+  input int      widths,
+  input int      hartid,
+  input int      fp,
+  input int      rd,
+  input int      pdst,
+  input longint  data
+);
+`endif
+
+module SimCommitLog #(parameter HARTID_BITS=0, PC_BITS=64, XLEN=64, FLEN=64) (
+  input              clock,
+  input              reset,
+  input [31:0]       hartid,
+
+  input              commit_valid,
+  input [2:0]        commit_priv,
+  input [63:0]       commit_pc,
+  input [31:0]       commit_insn,
+  input              commit_has_rd,
+  input              commit_fp,
+  input              commit_partial,
+  input [4:0]        commit_rd,
+  input [7:0]        commit_pdst,
+  input [63:0]       commit_data,
+
+  input              wb_valid,
+  input              wb_fp,
+  input [4:0]        wb_rd,
+  input [7:0]        wb_pdst,
+  input [63:0]       wb_data
+);
+
+`ifdef COMMIT_LOG
+  localparam [31:0] WIDTHS = HARTID_BITS | PC_BITS << 8 | XLEN << 16 | FLEN << 24;
+
+  always @(posedge clock) begin
+    if (!reset && commit_valid)
+      commit_log_commit(WIDTHS, hartid, {29'b0, commit_priv}, commit_pc, commit_insn,
+                        {31'b0, commit_has_rd}, {31'b0, commit_fp}, {31'b0, commit_partial},
+                        {27'b0, commit_rd}, {24'b0, commit_pdst}, commit_data);
+    if (!reset && wb_valid)
+      commit_log_writeback(WIDTHS, hartid, {31'b0, wb_fp}, {27'b0, wb_rd},
+                           {24'b0, wb_pdst}, wb_data);
+  end
+`endif
+
+endmodule
@@ -0,0 +1,144 @@
+// See LICENSE.SiFive for license details.
+//VCS coverage exclude_file
+
+// Counts the instructions a core retires, for the host to read when it
+// wants them (see csrc/SimCoreMonitor.cc), and with --profile, hands it the
+// PC the core last committed and its call stack every so many cycles (see
+// csrc/pc_profile.h). Only the emulator, which defines CORE_MONITOR, links
+// the C side; everywhere else this module is empty. The sampler, which
+// calls the host every cycle, is only built in with PC_PROFILE as well.
+
+`ifdef CORE_MONITOR
+import "DPI-C" context function void core_monitor_attach();
+`endif
+
+`ifdef PC_PROFILE
+import "DPI-C" function int pc_sample_tick
+(
+  input int      hartid,
+  input longint  cycle
+);
+
+import "DPI-C" function void pc_sample
+(
+  input int      hartid,
+  input longint  pc,
+  input int      depth
+);
+
+import "DPI-C" function void pc_sample_frame
+(
+  input int      hartid,
+  input longint  call_pc
+);
+
+import "DPI-C" function void pc_sample_end
+(
+  input int      hartid
+);
+`endif
+
+module SimCoreMonitor #(parameter XLEN=64) (
+  input              monitor_clock,
+  input              monitor_reset,
+  input [XLEN-1:0]   monitor_hartid,
+  input [31:0]       monitor_timer,
+  input              monitor_valid,
+  input [XLEN-1:0]   monitor_pc,
+  input [4:0]        monitor_wrdst,
+  input [XLEN-1:0]   monitor_wrdata,
+  input              monitor_wren,
+  input [4:0]        monitor_rd0src,
+  input [XLEN-1:0]   monitor_rd0val,
+  input [4:0]        monitor_rd1src,
+  input [XLEN-1:0]   monitor_rd1val,
+  input [31:0]       monitor_inst
+);
+
+`ifdef CORE_MONITOR
+  // The host reads the count through core_monitor_count, in this
+  // instance's scope, which core_monitor_attach gives it.
+  export "DPI-C" function core_monitor_count;
+
+  longint __instret;
+
+  function longint core_monitor_count;
+    core_monitor_count = __instret;
+  endfunction
+
+  initial begin
+    __instret = 0;
+    core_monitor_attach();
+  end
+
+  always @(posedge monitor_clock) begin
+    if (!monitor_reset && monitor_valid)
+      __instret = __instret + 1;
+  end
+
+`ifdef PC_PROFILE
+  // Loop variables index the arrays and select bits.
+  /* verilator lint_off WIDTH */
+  // The call stack is kept from the calls and returns the core commits, by
+  // the rules of the RISC-V return-address hints (x1 and x5 are link
+  // registers), as the PCs of the calls; only the innermost STACK_SIZE of
+  // them are kept. The last committed PC stands for the cycles in which
+  // nothing commits.
+  localparam STACK_SIZE = 64;
+
+  longint __cycles;
+  longint __pc;
+  longint __stack [0:STACK_SIZE-1];
+  int __depth;
+  int __tick;
+  integer i;
+
+  wire [4:0] __rd = monitor_inst[11:7];
+  wire [4:0] __rs1 = monitor_inst[19:15];
+  wire __rvc = monitor_inst[1:0] != 2'b11;
+  wire __jal = !__rvc && monitor_inst[6:0] == 7'b1101111;
+  wire __jalr = !__rvc && monitor_inst[6:0] == 7'b1100111;
+  // c.jr and c.jalr; c.jal, which only RV32 has
+  wire __c_jr = __rvc && monitor_inst[15:13] == 3'b100 && monitor_inst[1:0] == 2'b10 &&
+                monitor_inst[6:2] == 0 && monitor_inst[11:7] != 0;
+  wire __c_jal = __rvc && XLEN == 32 && monitor_inst[15:13] == 3'b001 &&
+                 monitor_inst[1:0] == 2'b01;
+  wire [4:0] __c_rs1 = monitor_inst[11:7];
+  wire __rd_link = __rd == 1 || __rd == 5;
+  wire __rs1_link = __rs1 == 1 || __rs1 == 5;
+  wire __c_rs1_link = __c_rs1 == 1 || __c_rs1 == 5;
+  wire __push = (__jal || __jalr) && __rd_link || __c_jr && monitor_inst[12] || __c_jal;
+  wire __pop = __jalr && __rs1_link && (!__rd_link || __rd != __rs1) ||
+               __c_jr && __c_rs1_link && !(monitor_inst[12] && __c_rs1 == 1);
+
+  always @(posedge monitor_clock) begin
+    if (monitor_reset) begin
+      __cycles = 0;
+      __pc = 0;
+      __depth = 0;
+    end else begin
+      __cycles = __cycles + 1;
+      // 0: not profiling; 1: following the stack; 2: a sample is due too.
+      __tick = pc_sample_tick(monitor_hartid[31:0], __cycles);
+      if (__tick != 0 && monitor_valid) begin
+        __pc = {{(64-XLEN){monitor_pc[XLEN-1]}}, monitor_pc};
+        if (__pop && __depth > 0)
+          __depth = __depth - 1;
+        if (__push) begin
+          __stack[__depth % STACK_SIZE] = __pc;
+          __depth = __depth + 1;
+        end
+      end
+      if (__tick == 2) begin
+        pc_sample(monitor_hartid[31:0], __pc, __depth);
+        for (i = 1; i <= STACK_SIZE && i <= __depth; i = i + 1)
+          pc_sample_frame(monitor_hartid[31:0], __stack[(__depth - i) % STACK_SIZE]);
+        pc_sample_end(monitor_hartid[31:0]);
+      end
+    end
+  end
+  /* verilator lint_on WIDTH */
+`endif
+`endif
+
+endmodule
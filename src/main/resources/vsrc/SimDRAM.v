@@ -0,0 +1,157 @@
+// See LICENSE.SiFive for license details.
+//VCS coverage exclude_file
+
+// An AXI4 slave served from a sparse memory on the host (see csrc/SimDRAM.h)
+// in place of the test harness's AXI4RAMs.
+
+import "DPI-C" function int sim_dram_attach
+(
+  input string  path,
+  input string  base,
+  input string  size,
+  input int     data_bits
+);
+
+import "DPI-C" function void sim_dram_tick
+(
+  input  int         handle,
+
+  input  bit         ar_valid,
+  output bit         ar_ready,
+  input  int         ar_id,
+  input  longint     ar_addr,
+  input  int         ar_len,
+  input  int         ar_size,
+  input  int         ar_burst,
+
+  input  bit         aw_valid,
+  output bit         aw_ready,
+  input  int         aw_id,
+  input  longint     aw_addr,
+  input  int         aw_len,
+  input  int         aw_size,
+  input  int         aw_burst,
+
+  input  bit         w_valid,
+  output bit         w_ready,
+  input  bit [511:0] w_data,
+  input  longint     w_strb,
+  input  bit         w_last,
+
+  output bit         b_valid,
+  input  bit         b_ready,
+  output int         b_id,
+  output int         b_resp,
+
+  output bit         r_valid,
+  input  bit         r_ready,
+  output int         r_id,
+  output bit [511:0] r_data,
+  output int         r_resp,
+  output bit         r_last
+);
+
+module SimDRAM #(parameter ADDR_BITS=32, DATA_BITS=64, ID_BITS=4,
+                 parameter string MEM_BASE="0", MEM_SIZE="0") (
+  input                      clock,
+  input                      reset,
+
+  input                      axi_aw_valid,
+  output                     axi_aw_ready,
+  input  [ID_BITS-1:0]       axi_aw_bits_id,
+  input  [ADDR_BITS-1:0]     axi_aw_bits_addr,
+  input  [7:0]               axi_aw_bits_len,
+  input  [2:0]               axi_aw_bits_size,
+  input  [1:0]               axi_aw_bits_burst,
+  input                      axi_aw_bits_lock,
+  input  [3:0]               axi_aw_bits_cache,
+  input  [2:0]               axi_aw_bits_prot,
+  input  [3:0]               axi_aw_bits_qos,
+
+  input                      axi_w_valid,
+  output                     axi_w_ready,
+  input  [DATA_BITS-1:0]     axi_w_bits_data,
+  input  [DATA_BITS/8-1:0]   axi_w_bits_strb,
+  input                      axi_w_bits_last,
+
+  output                     axi_b_valid,
+  input                      axi_b_ready,
+  output [ID_BITS-1:0]       axi_b_bits_id,
+  output [1:0]               axi_b_bits_resp,
+
+  input                      axi_ar_valid,
+  output                     axi_ar_ready,
+  input  [ID_BITS-1:0]       axi_ar_bits_id,
+  input  [ADDR_BITS-1:0]     axi_ar_bits_addr,
+  input  [7:0]               axi_ar_bits_len,
+  input  [2:0]               axi_ar_bits_size,
+  input  [1:0]               axi_ar_bits_burst,
+  input                      axi_ar_bits_lock,
+  input  [3:0]               axi_ar_bits_cache,
+  input  [2:0]               axi_ar_bits_prot,
+  input  [3:0]               axi_ar_bits_qos,
+
+  output                     axi_r_valid,
+  input                      axi_r_ready,
+  output [ID_BITS-1:0]       axi_r_bits_id,
+  output [DATA_BITS-1:0]     axi_r_bits_data,
+  output [1:0]               axi_r_bits_resp,
+  output                     axi_r_bits_last
+);
+
+  int __handle;
+  initial __handle = sim_dram_attach($sformatf("%m"), MEM_BASE, MEM_SIZE, DATA_BITS);
+
+  bit __ar_ready;
+  bit __aw_ready;
+  bit __w_ready;
+  bit __b_valid;
+  int __b_id;
+  int __b_resp;
+  bit __r_valid;
+  int __r_id;
+  bit [511:0] __r_data;
+  int __r_resp;
+  bit __r_last;
+
+  assign #0.1 axi_ar_ready = __ar_ready;
+  assign #0.1 axi_aw_ready = __aw_ready;
+  assign #0.1 axi_w_ready = __w_ready;
+  assign #0.1 axi_b_valid = __b_valid;
+  assign #0.1 axi_b_bits_id = __b_id[ID_BITS-1:0];
+  assign #0.1 axi_b_bits_resp = __b_resp[1:0];
+  assign #0.1 axi_r_valid = __r_valid;
+  assign #0.1 axi_r_bits_id = __r_id[ID_BITS-1:0];
+  assign #0.1 axi_r_bits_data = __r_data[DATA_BITS-1:0];
+  assign #0.1 axi_r_bits_resp = __r_resp[1:0];
+  assign #0.1 axi_r_bits_last = __r_last;
+
+  always @(posedge clock)
+  begin
+    if (reset)
+    begin
+      __ar_ready = 0;
+      __aw_ready = 0;
+      __w_ready = 0;
+      __b_valid = 0;
+      __r_valid = 0;
+    end
+    else
+    begin
+      sim_dram_tick(
+        __handle,
+        axi_ar_valid, __ar_ready, {{(32-ID_BITS){1'b0}}, axi_ar_bits_id},
+        {{(64-ADDR_BITS){1'b0}}, axi_ar_bits_addr}, {24'b0, axi_ar_bits_len},
+        {29'b0, axi_ar_bits_size}, {30'b0, axi_ar_bits_burst},
+        axi_aw_valid, __aw_ready, {{(32-ID_BITS){1'b0}}, axi_aw_bits_id},
+        {{(64-ADDR_BITS){1'b0}}, axi_aw_bits_addr}, {24'b0, axi_aw_bits_len},
+        {29'b0, axi_aw_bits_size}, {30'b0, axi_aw_bits_burst},
+        axi_w_valid, __w_ready, {{(512-DATA_BITS){1'b0}}, axi_w_bits_data},
+        {{(64-DATA_BITS/8){1'b0}}, axi_w_bits_strb}, axi_w_bits_last,
+        __b_valid, axi_b_ready, __b_id, __b_resp,
+        __r_valid, axi_r_ready, __r_id, __r_data, __r_resp, __r_last
+      );
+    end
+  end
+
+endmodule
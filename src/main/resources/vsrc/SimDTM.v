@@ -12,7 +12,10 @@ import "DPI-C" function int debug_tick
   input  bit        debug_resp_valid,
   output bit        debug_resp_ready,
   input  int        debug_resp_bits_resp,
-  input  int        debug_resp_bits_data
+  input  int        debug_resp_bits_data,
+
+  output int        debug_wait,
+  output int        debug_skip
 );
 
 module SimDTM(
@@ -45,6 +48,8 @@ module SimDTM(
   int __debug_req_bits_op;
   int __debug_req_bits_data;
   bit __debug_resp_ready;
+  int __debug_wait;
+  int __debug_skip;
   int __exit;
 
   assign #0.1 debug_req_valid = __debug_req_valid;
@@ -61,9 +66,22 @@ module SimDTM(
     begin
       __debug_req_valid = 0;
       __debug_resp_ready = 0;
+      __debug_wait = 0;
+      __debug_skip = 0;
       __exit = 0;
     end
-    else
+    // debug_tick asked to be left alone for __debug_skip cycles, while dtm_t
+    // waits for the target with nothing on the pins.
+    else if (__debug_skip != 0)
+    begin
+      __debug_skip = __debug_skip - 1;
+    end
+    // debug_tick asked not to be called again until one of the inputs in
+    // the __debug_wait mask (1: req_ready, 2: resp_valid) goes high; until
+    // then it would have nothing to do.
+    else if (__debug_wait == 0 ||
+             (__debug_wait[0] && __debug_req_ready) ||
+             (__debug_wait[1] && __debug_resp_valid))
     begin
       __exit = debug_tick(
         __debug_req_valid,
@@ -74,7 +92,9 @@ module SimDTM(
         __debug_resp_valid,
         __debug_resp_ready,
         __debug_resp_bits_resp,
-        __debug_resp_bits_data
+        __debug_resp_bits_data,
+        __debug_wait,
+        __debug_skip
       );
     end
   end
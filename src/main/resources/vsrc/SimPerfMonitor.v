@@ -0,0 +1,90 @@
+// See LICENSE.SiFive for license details.
+//VCS coverage exclude_file
+
+// Hands a core's counters, and a count of each event the counters can
+// select, to the host every so many cycles (see csrc/SimPerfMonitor.h).
+// Only the emulator, which defines PERF_SAMPLE, links the C side; everywhere
+// else this module is empty.
+
+`ifdef PERF_SAMPLE
+import "DPI-C" function int perf_sample_tick
+(
+  input int      hartid,
+  input longint  cycle
+);
+
+import "DPI-C" function void perf_sample_start
+(
+  input int      hartid,
+  input longint  cycle,
+  input string   event_names,
+  input int      n_counters,
+  input int      n_events
+);
+
+import "DPI-C" function void perf_sample_value
+(
+  input int      hartid,
+  input longint  value
+);
+
+import "DPI-C" function void perf_sample_end
+(
+  input int      hartid
+);
+`endif
+
+module SimPerfMonitor #(parameter N_EVENTS=1, N_COUNTERS=0,
+                        parameter string EVENT_NAMES="") (
+  input                                    clock,
+  input                                    reset,
+  input [31:0]                             hartid,
+  input [63:0]                             cycle,
+  input [63:0]                             instret,
+  input [64*(N_COUNTERS > 0 ? N_COUNTERS : 1)-1:0] hpmcounters,
+  input [64*(N_COUNTERS > 0 ? N_COUNTERS : 1)-1:0] hpmevents,
+  input [N_EVENTS-1:0]                     events
+);
+
+`ifdef PERF_SAMPLE
+  // Loop variables index the arrays and select bits.
+  /* verilator lint_off WIDTH */
+  // Cycles since reset, which unlike mcycle the program cannot write, and
+  // the events seen in them; both come back with a checkpoint.
+  longint __cycles;
+  longint __counts [0:N_EVENTS-1];
+  int __tick;
+  integer i;
+
+  always @(posedge clock) begin
+    if (reset) begin
+      __cycles = 0;
+      for (i = 0; i < N_EVENTS; i = i + 1)
+        __counts[i] = 0;
+    end else begin
+      __cycles = __cycles + 1;
+      // 0: not sampling; 1: counting; 2: counting, and a sample is due.
+      __tick = perf_sample_tick(hartid, __cycles);
+      if (__tick != 0) begin
+        for (i = 0; i < N_EVENTS; i = i + 1)
+          if (events[i])
+            __counts[i] = __counts[i] + 1;
+      end
+      if (__tick == 2) begin
+        perf_sample_start(hartid, __cycles, EVENT_NAMES, N_COUNTERS, N_EVENTS);
+        perf_sample_value(hartid, cycle);
+        perf_sample_value(hartid, instret);
+        for (i = 0; i < N_COUNTERS; i = i + 1)
+          perf_sample_value(hartid, hpmcounters[64*i +: 64]);
+        for (i = 0; i < N_COUNTERS; i = i + 1)
+          perf_sample_value(hartid, hpmevents[64*i +: 64]);
+        for (i = 0; i < N_EVENTS; i = i + 1)
+          perf_sample_value(hartid, __counts[i]);
+        perf_sample_end(hartid);
+      end
+    end
+  end
+  /* verilator lint_on WIDTH */
+`endif
+
+endmodule
@@ -158,7 +158,10 @@ class SimDTM(implicit p: Parameters) extends BlackBox with HasBlackBoxResource {
   }
 
   addResource("/vsrc/SimDTM.v")
+  addResource("/csrc/SimDTM.h")
   addResource("/csrc/SimDTM.cc")
+  addResource("/csrc/sim_stats.h")
+  addResource("/csrc/sim_stats.cc")
 }
 
 class SimJTAG(tickDelay: Int = 50) extends BlackBox(Map("TICK_DELAY" -> IntParam(tickDelay)))
@@ -194,6 +197,9 @@ class SimJTAG(tickDelay: Int = 50) extends BlackBox(Map("TICK_DELAY" -> IntParam
   addResource("/csrc/SimJTAG.cc")
   addResource("/csrc/remote_bitbang.h")
   addResource("/csrc/remote_bitbang.cc")
+  addResource("/csrc/rbb_shm.h")
+  addResource("/csrc/sim_stats.h")
+  addResource("/csrc/sim_stats.cc")
 }
 
 object Debug {
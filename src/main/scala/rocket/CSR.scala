@@ -160,6 +160,15 @@ class PerfCounterIO(implicit p: Parameters) extends CoreBundle
   val inc = UInt(INPUT, log2Ceil(1+retireWidth))
 }
 
+// What the counters hold, for simulation-only monitors (SimPerfMonitor)
+class CounterValues(implicit p: Parameters) extends CoreBundle
+    with HasCoreParameters {
+  val cycle = UInt(width = 64)
+  val instret = UInt(width = 64)
+  val hpmcounter = Vec(nPerfCounters, UInt(width = CSR.hpmWidth))
+  val hpmevent = Vec(nPerfCounters, UInt(width = xLen))
+}
+
 class TracedInstruction(implicit p: Parameters) extends CoreBundle with Clocked {
   val valid = Bool()
   val iaddr = UInt(width = coreMaxAddrBits)
@@ -218,6 +227,7 @@ class CSRFileIO(implicit p: Parameters) extends CoreBundle
   val bp = Vec(nBreakpoints, new BP).asOutput
   val pmp = Vec(nPMPs, new PMP).asOutput
   val counters = Vec(nPerfCounters, new PerfCounterIO)
+  val counterValues = new CounterValues().asOutput
   val csrw_counter = UInt(OUTPUT, CSR.nCtr)
   val inst = Vec(retireWidth, UInt(width = iLen)).asInput
   val trace = Vec(retireWidth, new TracedInstruction).asOutput
@@ -661,6 +671,12 @@ class CSRFile(
   }
 
   io.time := reg_cycle
+  io.counterValues.cycle := reg_cycle
+  io.counterValues.instret := reg_instret
+  for (((v, e), (c, s)) <- (io.counterValues.hpmcounter zip io.counterValues.hpmevent) zip (reg_hpmcounter zip reg_hpmevent)) {
+    v := c
+    e := s
+  }
   io.csr_stall := reg_wfi || io.status.cease
   io.status.cease := RegEnable(true.B, false.B, insn_cease)
 
@@ -9,8 +9,14 @@ import freechips.rocketchip.util.property._
 
 class EventSet(gate: (UInt, UInt) => Bool, events: Seq[(String, () => Bool)]) {
   def size = events.size
+  def names = events.map(_._1)
   def hits = events.map(_._2()).asUInt
   def check(mask: UInt) = gate(mask, hits)
+  // Every event on its own, as a counter that selects only it sees it
+  def each: Seq[(String, Bool)] = {
+    val h = hits
+    for ((name, i) <- names.zipWithIndex) yield (name, gate(UInt(BigInt(1) << i), h))
+  }
   def dump() {
     for (((name, _), i) <- events.zipWithIndex)
       when (check(1.U << i)) { printf(s"Event $name\n") }
@@ -41,6 +47,8 @@ class EventSets(val eventSets: Seq[EventSet]) {
     sets(set)
   }
 
+  def each: Seq[(String, Bool)] = eventSets.flatMap(_.each)
+
   def cover() = eventSets.foreach { _ withCovers }
 
   private def eventSetIdBits = 8
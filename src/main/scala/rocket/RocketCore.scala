@@ -855,6 +855,23 @@ class Rocket(tile: RocketTile)(implicit p: Parameters) extends CoreModule()(p)
   coreMonitorBundle.rd1val := Reg(next=Reg(next=ex_rs(1)))
   coreMonitorBundle.inst := csr.io.trace(0).insn
 
+  // Every event, whatever the counters are set to count, and the counters,
+  // for a SimPerfMonitor in the test harness to sample (--perf-samples)
+  val perfMonitorBundle = if (!p(UseSimPerfMonitor)) None else Some {
+    val hits = perfEvents.each
+    val b = Wire(new PerfMonitorBundle(hits.map(_._1), nPerfCounters))
+    b.clock := clock
+    b.reset := reset
+    b.hartid := io.hartid
+    b.cycle := csr.io.counterValues.cycle
+    b.instret := csr.io.counterValues.instret
+    b.hpmcounters := csr.io.counterValues.hpmcounter
+    b.hpmevents := csr.io.counterValues.hpmevent
+    for ((e, (_, hit)) <- b.events zip hits)
+      e := RegNext(hit)
+    b
+  }
+
   if (enableCommitLog) {
     val t = csr.io.trace(0)
     val rd = wb_waddr
@@ -862,24 +879,51 @@ class Rocket(tile: RocketTile)(implicit p: Parameters) extends CoreModule()(p)
     val wxd = wb_ctrl.wxd
     val has_data = wb_wen && !wb_set_sboard
 
+    // With more than one hart, each line starts with "C<hartid>: " so that
+    // comlog can split the log back up into one stream per hart.
+    def commitLog(fmt: String, data: Bits*) =
+      if (commitLogHartIdBits > 0) printf("C%d: " + fmt, (io.hartid +: data):_*)
+      else printf(fmt, data:_*)
+
     when (t.valid && !t.exception) {
       when (wfd) {
-        printf ("%d 0x%x (0x%x) f%d p%d 0xXXXXXXXXXXXXXXXX\n", t.priv, t.iaddr, t.insn, rd, rd+UInt(32))
+        commitLog("%d 0x%x (0x%x) f%d p%d 0xXXXXXXXXXXXXXXXX\n", t.priv, t.iaddr, t.insn, rd, rd+UInt(32))
       }
       .elsewhen (wxd && rd =/= UInt(0) && has_data) {
-        printf ("%d 0x%x (0x%x) x%d 0x%x\n", t.priv, t.iaddr, t.insn, rd, rf_wdata)
+        commitLog("%d 0x%x (0x%x) x%d 0x%x\n", t.priv, t.iaddr, t.insn, rd, rf_wdata)
       }
       .elsewhen (wxd && rd =/= UInt(0) && !has_data) {
-        printf ("%d 0x%x (0x%x) x%d p%d 0xXXXXXXXXXXXXXXXX\n", t.priv, t.iaddr, t.insn, rd, rd)
+        commitLog("%d 0x%x (0x%x) x%d p%d 0xXXXXXXXXXXXXXXXX\n", t.priv, t.iaddr, t.insn, rd, rd)
       }
       .otherwise {
-        printf ("%d 0x%x (0x%x)\n", t.priv, t.iaddr, t.insn)
+        commitLog("%d 0x%x (0x%x)\n", t.priv, t.iaddr, t.insn)
       }
     }
 
     when (ll_wen && rf_waddr =/= UInt(0)) {
-      printf ("x%d p%d 0x%x\n", rf_waddr, rf_waddr, rf_wdata)
+      commitLog("x%d p%d 0x%x\n", rf_waddr, rf_waddr, rf_wdata)
     }
+
+    // The same, in binary, for the emulator's --commit-log
+    val binaryLog = Module(new SimCommitLog(commitLogHartIdBits, coreMaxAddrBits, xLen, fLen))
+    binaryLog.io.clock := clock
+    binaryLog.io.reset := reset
+    binaryLog.io.hartid := (if (commitLogHartIdBits > 0) io.hartid else UInt(0))
+    binaryLog.io.commit.valid := t.valid && !t.exception
+    binaryLog.io.commit.priv := t.priv
+    binaryLog.io.commit.pc := t.iaddr
+    binaryLog.io.commit.insn := t.insn
+    binaryLog.io.commit.has_rd := wfd || (wxd && rd =/= UInt(0))
+    binaryLog.io.commit.fp := wfd
+    binaryLog.io.commit.partial := wfd || !has_data
+    binaryLog.io.commit.rd := rd
+    binaryLog.io.commit.pdst := Mux(wfd, rd + UInt(32), rd)
+    binaryLog.io.commit.data := rf_wdata
+    binaryLog.io.wb.valid := ll_wen && rf_waddr =/= UInt(0)
+    binaryLog.io.wb.fp := Bool(false)
+    binaryLog.io.wb.rd := rf_waddr
+    binaryLog.io.wb.pdst := rf_waddr
+    binaryLog.io.wb.data := rf_wdata
   }
   else {
     printf("C%d: %d [%d] pc=[%x] W[r%d=%x][%d] R[r%d=%x] R[r%d=%x] inst=[%x] DASM(%x)\n",
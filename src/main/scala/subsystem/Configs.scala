@@ -331,6 +331,18 @@ class WithExtMemSize(n: Long) extends Config((site, here, up) => {
   case ExtMem => up(ExtMem, site).map(x => x.copy(master = x.master.copy(size = n)))
 })
 
+class WithSimDRAM extends Config((site, here, up) => {
+  case UseSimDRAM => true
+})
+
+class WithCommitLog extends Config((site, here, up) => {
+  case EnableCommitLog => true
+})
+
+class WithSimPerfMonitor extends Config((site, here, up) => {
+  case UseSimPerfMonitor => true
+})
+
 class WithDTS(model: String, compat: Seq[String]) extends Config((site, here, up) => {
   case DTSModel => model
   case DTSCompat => compat
@@ -3,6 +3,8 @@
 package freechips.rocketchip.subsystem
 
 import Chisel._
+import chisel3.experimental.{IntParam, StringParam}
+import chisel3.util.HasBlackBoxResource
 import freechips.rocketchip.config.{Field, Parameters}
 import freechips.rocketchip.diplomacy._
 import freechips.rocketchip.tilelink._
@@ -25,6 +27,8 @@ case class MemoryPortParams(master: MasterPortParams, nMemoryChannels: Int)
 case object ExtMem extends Field[Option[MemoryPortParams]](None)
 case object ExtBus extends Field[Option[MasterPortParams]](None)
 case object ExtIn extends Field[Option[SlavePortParams]](None)
+/** Whether connectSimAXIMem gives the memory port a SimDRAM instead of a SimAXIMem */
+case object UseSimDRAM extends Field[Boolean](false)
 
 ///// The following traits add ports to the sytem, in some cases converting to different interconnect standards
 
@@ -72,8 +76,13 @@ trait CanHaveMasterAXI4MemPortModuleImp extends LazyModuleImp {
   def connectSimAXIMem() {
     (mem_axi4 zip outer.memAXI4Node).foreach { case (io, node) =>
       (io zip node.in).foreach { case (io, (_, edge)) =>
-        val mem = LazyModule(new SimAXIMem(edge, size = p(ExtMem).get.master.size))
-        Module(mem.module).io.axi4.head <> io
+        val params = p(ExtMem).get.master
+        if (p(UseSimDRAM)) {
+          Module(new SimDRAM(edge.bundle, params.base, params.size)).connect(clock, reset, io)
+        } else {
+          val mem = LazyModule(new SimAXIMem(edge, size = params.size))
+          Module(mem.module).io.axi4.head <> io
+        }
       }
     }
   }
@@ -228,3 +237,42 @@ class SimAXIMem(edge: AXI4EdgeParameters, size: BigInt)(implicit p: Parameters)
     (node.out zip io.axi4) foreach { case ((bundle, _), io) => bundle <> io }
   }
 }
+
+/** Memory with AXI port for use in the emulator's test harness, kept by the
+  * simulator in a sparse store on the host (see csrc/SimDRAM.h) rather than
+  * built from AXI4RAMs, so it can be many GiB.
+  */
+class SimDRAM(params: AXI4BundleParameters, base: BigInt, size: BigInt) extends BlackBox(Map(
+    "ADDR_BITS" -> IntParam(params.addrBits),
+    "DATA_BITS" -> IntParam(params.dataBits),
+    "ID_BITS" -> IntParam(params.idBits),
+    // strings, since Verilog integer parameters are only 32 bits
+    "MEM_BASE" -> StringParam("0x" + base.toString(16)),
+    "MEM_SIZE" -> StringParam("0x" + size.toString(16))))
+    with HasBlackBoxResource {
+  require(params.dataBits <= 512, s"SimDRAM data bits must be <= 512 (got ${params.dataBits})")
+  require(params.addrBits <= 64 && params.idBits <= 32)
+  require(params.userBits == 0 && !params.wcorrupt)
+
+  val io = new Bundle {
+    val clock = Clock(INPUT)
+    val reset = Bool(INPUT)
+    val axi = AXI4Bundle(params).flip
+  }
+
+  def connect(clock: Clock, reset: Bool, axi: AXI4Bundle) = {
+    io.clock := clock
+    io.reset := reset
+    io.axi <> axi
+  }
+
+  addResource("/vsrc/SimDRAM.v")
+  addResource("/csrc/SimDRAM.h")
+  addResource("/csrc/SimDRAM.cc")
+  addResource("/csrc/dram_timing.h")
+  addResource("/csrc/dram_timing.cc")
+  addResource("/csrc/mem_backdoor.h")
+  addResource("/csrc/mem_backdoor.cc")
+  addResource("/csrc/sim_stats.h")
+  addResource("/csrc/sim_stats.cc")
+}
@@ -57,6 +57,11 @@ trait HasRocketTiles extends HasTiles
   def coreMonitorBundles = (rocketTiles map { t =>
     t.module.core.rocketImpl.coreMonitorBundle
   }).toList
+
+  // Empty unless UseSimPerfMonitor is set
+  def perfMonitorBundles = (rocketTiles flatMap { t =>
+    t.module.core.rocketImpl.perfMonitorBundle
+  }).toList
 }
 
 trait HasRocketTilesModuleImp extends HasTilesModuleImp
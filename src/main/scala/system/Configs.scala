@@ -51,6 +51,12 @@ class DualChannelBenchmarkConfig extends Config(new WithNMemoryChannels(2) ++ ne
 class QuadChannelBenchmarkConfig extends Config(new WithNMemoryChannels(4) ++ new SingleChannelBenchmarkConfig)
 class OctoChannelBenchmarkConfig extends Config(new WithNMemoryChannels(8) ++ new SingleChannelBenchmarkConfig)
 
+class CosimConfig extends Config(new WithCommitLog ++ new DefaultConfig)
+
+class SimDRAMConfig extends Config(new WithSimDRAM ++ new DefaultConfig)
+class SimDRAM16GBConfig extends Config(new WithExtMemSize(0x400000000L) ++ new SimDRAMConfig)
+class DualChannelSimDRAMConfig extends Config(new WithNMemoryChannels(2) ++ new SimDRAMConfig)
+
 class EightChannelConfig extends Config(new WithNMemoryChannels(8) ++ new BaseConfig)
 
 class DualCoreConfig extends Config(
@@ -6,6 +6,7 @@ import Chisel._
 import freechips.rocketchip.config.Parameters
 import freechips.rocketchip.devices.debug.Debug
 import freechips.rocketchip.diplomacy.LazyModule
+import freechips.rocketchip.util.{SimCoreMonitor, SimPerfMonitor}
 
 class TestHarness()(implicit p: Parameters) extends Module {
   val io = new Bundle {
@@ -21,4 +22,7 @@ class TestHarness()(implicit p: Parameters) extends Module {
   dut.connectSimAXIMMIO()
   dut.l2_frontend_bus_axi4.foreach(_.tieoff)
   Debug.connectDebug(dut.debug, clock, reset, io.success)
+
+  dut.outer.coreMonitorBundles.foreach(SimCoreMonitor.attach)
+  dut.outer.perfMonitorBundles.foreach(SimPerfMonitor.attach)
 }
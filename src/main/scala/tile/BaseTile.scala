@@ -61,6 +61,9 @@ trait HasNonDiplomaticTileParameters {
 
   def hartId: Int = tileParams.hartId
   def hartIdLen: Int = p(MaxHartIdBits)
+  // Bits of hartid the commit log starts each line with, or 0 for none, as
+  // with a single hart (for which MaxHartIdBits is still 1)
+  def commitLogHartIdBits: Int = if (p(RocketTilesKey).size > 1) hartIdLen else 0
 
   def cacheBlockBytes = p(CacheBlockBytes)
   def lgCacheBlockBytes = log2Up(cacheBlockBytes)
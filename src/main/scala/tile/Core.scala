@@ -9,6 +9,7 @@ import freechips.rocketchip.rocket._
 import freechips.rocketchip.util._
 
 case object XLen extends Field[Int]
+case object EnableCommitLog extends Field[Boolean](false)
 
 // These parameters can be varied per-core
 trait CoreParams {
@@ -83,7 +84,7 @@ trait HasCoreParameters extends HasTileParameters {
 
   // Print out log of committed instructions and their writeback values.
   // Requires post-processing due to out-of-order writebacks.
-  val enableCommitLog = false
+  val enableCommitLog = p(EnableCommitLog)
 
 }
 
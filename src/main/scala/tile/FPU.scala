@@ -687,6 +687,27 @@ class FPU(cfg: FPUParams)(implicit p: Parameters) extends FPUModule()(p) {
   val load_wb_data = RegEnable(io.dmem_resp_data, io.dmem_resp_val)
   val load_wb_tag = RegEnable(io.dmem_resp_tag, io.dmem_resp_val)
 
+  // Commit log lines for FP register write-backs (see RocketCore.scala),
+  // printed and, for the emulator's --commit-log, in binary
+  def commitLogWriteback(valid: Bool, rd: UInt, data: UInt) = if (enableCommitLog) {
+    val hartDigits = ((BigInt(1) << commitLogHartIdBits) - 1).toString.length
+    val prefix = if (commitLogHartIdBits > 0) s"C%${hartDigits}d: ".format(hartId) else ""
+    when (valid) {
+      printf(prefix + "f%d p%d 0x%x\n", rd, rd + UInt(32), data)
+    }
+
+    val binaryLog = Module(new SimCommitLog(commitLogHartIdBits, coreMaxAddrBits, xLen, fLen))
+    binaryLog.io.clock := gated_clock
+    binaryLog.io.reset := reset
+    binaryLog.io.hartid := UInt(hartId)
+    binaryLog.io.commit := UInt(0).asTypeOf(new SimCommitLogCommit)
+    binaryLog.io.wb.valid := valid
+    binaryLog.io.wb.fp := Bool(true)
+    binaryLog.io.wb.rd := rd
+    binaryLog.io.wb.pdst := rd + UInt(32)
+    binaryLog.io.wb.data := data
+  }
+
   @chiselName class FPUImpl { // entering gated-clock domain
 
   val req_valid = ex_reg_valid || io.cp_req.valid
@@ -718,9 +739,8 @@ class FPU(cfg: FPUParams)(implicit p: Parameters) extends FPUModule()(p) {
     val wdata = recode(load_wb_data, load_wb_double)
     regfile(load_wb_tag) := wdata
     assert(consistent(wdata))
-    if (enableCommitLog)
-      printf("f%d p%d 0x%x\n", load_wb_tag, load_wb_tag + 32, load_wb_data)
   }
+  commitLogWriteback(load_wb, load_wb_tag, load_wb_data)
 
   val ex_rs = ex_ra.map(a => regfile(a))
   when (io.valid) {
@@ -847,10 +867,8 @@ class FPU(cfg: FPUParams)(implicit p: Parameters) extends FPUModule()(p) {
   when ((!wbInfo(0).cp && wen(0)) || divSqrt_wen) {
     assert(consistent(wdata))
     regfile(waddr) := wdata
-    if (enableCommitLog) {
-      printf("f%d p%d 0x%x\n", waddr, waddr + 32, ieee(wdata))
-    }
   }
+  commitLogWriteback((!wbInfo(0).cp && wen(0)) || divSqrt_wen, waddr, ieee(wdata))
   when (wbInfo(0).cp && wen(0)) {
     io.cp_resp.bits.data := wdata
     io.cp_resp.valid := Bool(true)
@@ -0,0 +1,55 @@
+// See LICENSE.SiFive for license details.
+
+package freechips.rocketchip.util
+
+import chisel3._
+import chisel3.experimental.IntParam
+import chisel3.util.HasBlackBoxResource
+
+// An instruction retiring, as the commit log prints it: rd is written with
+// data, or, for a partial commit, later by a SimCommitLogWriteback with the
+// same pdst
+class SimCommitLogCommit extends Bundle {
+  val valid = Bool()
+  val priv = UInt(3.W)
+  val pc = UInt(64.W)
+  val insn = UInt(32.W)
+  val has_rd = Bool()
+  val fp = Bool()
+  val partial = Bool()
+  val rd = UInt(5.W)
+  val pdst = UInt(8.W)
+  val data = UInt(64.W)
+}
+
+class SimCommitLogWriteback extends Bundle {
+  val valid = Bool()
+  val fp = Bool()
+  val rd = UInt(5.W)
+  val pdst = UInt(8.W)
+  val data = UInt(64.W)
+}
+
+// simulation-only sink for the commit log, which the emulator writes in
+// binary with --commit-log (see csrc/commit_log.h); the widths are those of
+// the signals the commit log printfs print, so that the binary log can be
+// turned back into the same text
+class SimCommitLog(hartIdBits: Int, pcBits: Int, xLen: Int, fLen: Int) extends BlackBox(Map(
+    "HARTID_BITS" -> IntParam(hartIdBits),
+    "PC_BITS" -> IntParam(pcBits),
+    "XLEN" -> IntParam(xLen),
+    "FLEN" -> IntParam(fLen)))
+    with HasBlackBoxResource {
+  val io = IO(new Bundle {
+    val clock = Input(Clock())
+    val reset = Input(Bool())
+    val hartid = Input(UInt(32.W))
+    val commit = Input(new SimCommitLogCommit)
+    val wb = Input(new SimCommitLogWriteback)
+  })
+
+  addResource("/vsrc/SimCommitLog.v")
+  addResource("/csrc/SimCommitLog.h")
+  addResource("/csrc/SimCommitLog.cc")
+  addResource("/csrc/commit_log.h")
+}
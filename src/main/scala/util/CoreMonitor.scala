@@ -4,6 +4,9 @@
 package freechips.rocketchip.util
 
 import chisel3._
+import chisel3.experimental.IntParam
+import chisel3.util.HasBlackBoxResource
+import chisel3.util.experimental.BoringUtils
 
 // this bundle is used to expose some internal core signals
 // to verification monitors which sample instruction commits
@@ -26,3 +29,41 @@ class CoreMonitorBundle(val xLen: Int) extends Bundle with Clocked {
 trait HasCoreMonitorBundles {
     def coreMonitorBundles: List[CoreMonitorBundle]
 }
+
+// A copy, in the current module, of a signal from anywhere in the design,
+// wired up to it through the hierarchy by BoringUtils. This is how the test
+// harness attaches simulation monitors, so none are built into the design.
+object MonitorTap {
+  def apply[T <: Data](source: T): T = {
+    def leaves(d: Data): Seq[Data] = d match {
+      case a: Aggregate => a.getElements.flatMap(leaves)
+      case e => Seq(e)
+    }
+    val sink = Wire(source.cloneType)
+    sink := DontCare
+    (leaves(source) zip leaves(sink)) foreach { case (from, to) => BoringUtils.bore(from, Seq(to)) }
+    sink
+  }
+}
+
+// simulation-only sink for a core's CoreMonitorBundle, which reports
+// retired instructions to the emulator host code, and samples the PC and
+// call stack for its profiler
+class SimCoreMonitor(val xLen: Int) extends BlackBox(Map("XLEN" -> IntParam(xLen)))
+    with HasBlackBoxResource {
+  val io = IO(new Bundle {
+    val monitor = Input(new CoreMonitorBundle(xLen))
+  })
+
+  addResource("/vsrc/SimCoreMonitor.v")
+  addResource("/csrc/SimCoreMonitor.h")
+  addResource("/csrc/SimCoreMonitor.cc")
+  addResource("/csrc/pc_profile.h")
+  addResource("/csrc/pc_profile.cc")
+}
+
+object SimCoreMonitor {
+  // Attach a monitor in the test harness to a core's CoreMonitorBundle
+  def attach(monitor: CoreMonitorBundle): Unit =
+    Module(new SimCoreMonitor(monitor.xLen)).io.monitor := MonitorTap(monitor)
+}
@@ -0,0 +1,75 @@
+// See LICENSE.SiFive for license details.
+
+package freechips.rocketchip.util
+
+import chisel3._
+import chisel3.experimental.{IntParam, StringParam}
+import chisel3.util.{Cat, HasBlackBoxResource}
+import freechips.rocketchip.config.Field
+
+// Whether cores expose a PerfMonitorBundle for the test harness to attach a
+// SimPerfMonitor to; off by default, so designs carry none of its logic
+case object UseSimPerfMonitor extends Field[Boolean](false)
+
+// A core's counters, and a bit for each event the counters can select, set
+// when the event happened in the previous cycle
+class PerfMonitorBundle(val eventNames: Seq[String], val nCounters: Int) extends Bundle with Clocked {
+  val hartid = UInt(32.W)
+  val cycle = UInt(64.W)
+  val instret = UInt(64.W)
+  val hpmcounters = Vec(nCounters, UInt(64.W))
+  val hpmevents = Vec(nCounters, UInt(64.W))
+  val events = Vec(eventNames.size, Bool())
+}
+
+// simulation-only sink for a core's counters and events, which the emulator
+// samples every so many cycles with --perf-samples (see
+// csrc/SimPerfMonitor.h): the cycle and instret counters, the HPM counters
+// and what they are set to count, and a count kept on the host of each of
+// the events the HPM counters can select
+class SimPerfMonitor(eventNames: Seq[String], nCounters: Int) extends BlackBox(Map(
+    "N_EVENTS" -> IntParam(eventNames.size max 1),
+    "N_COUNTERS" -> IntParam(nCounters),
+    "EVENT_NAMES" -> StringParam(eventNames.mkString(","))))
+    with HasBlackBoxResource {
+  require(eventNames.forall(n => !n.contains(",") && !n.contains("\"")))
+
+  val io = IO(new Bundle {
+    val clock = Input(Clock())
+    val reset = Input(Bool())
+    val hartid = Input(UInt(32.W))
+    val cycle = Input(UInt(64.W))
+    val instret = Input(UInt(64.W))
+    val hpmcounters = Input(UInt((64 * (nCounters max 1)).W))
+    val hpmevents = Input(UInt((64 * (nCounters max 1)).W))
+    val events = Input(UInt((eventNames.size max 1).W))
+  })
+
+  // Counter i is in bits [64*i+63:64*i], event i in bit i.
+  def connect(clock: Clock, reset: Bool, hartid: UInt, cycle: UInt, instret: UInt,
+              hpmcounters: Seq[UInt], hpmevents: Seq[UInt], events: Seq[Bool]): Unit = {
+    def pack(xs: Seq[UInt], width: Int) =
+      if (xs.isEmpty) 0.U else Cat(xs.reverse.map(x => x.pad(width)))
+    io.clock := clock
+    io.reset := reset
+    io.hartid := hartid
+    io.cycle := cycle
+    io.instret := instret
+    io.hpmcounters := pack(hpmcounters, 64)
+    io.hpmevents := pack(hpmevents, 64)
+    io.events := pack(events, 1)
+  }
+
+  addResource("/vsrc/SimPerfMonitor.v")
+  addResource("/csrc/SimPerfMonitor.h")
+  addResource("/csrc/SimPerfMonitor.cc")
+}
+
+object SimPerfMonitor {
+  // Attach a monitor in the test harness to a core's PerfMonitorBundle
+  def attach(perf: PerfMonitorBundle): Unit = {
+    val b = MonitorTap(perf)
+    Module(new SimPerfMonitor(perf.eventNames, perf.nCounters)).connect(
+      b.clock, b.reset, b.hartid, b.cycle, b.instret, b.hpmcounters, b.hpmevents, b.events)
+  }
+}